@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/dataset_5d.hpp"
+#include "hpg/su_mmap.hpp"
+
+#include <boost/geometry/algorithms/expand.hpp>
+#include <boost/geometry/algorithms/assign.hpp>
+#include <boost/geometry/arithmetic/arithmetic.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cmath>
+
+#include <stdint.h>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <time.h>
+
+namespace {
+
+struct bench_options
+{
+    size_t nqueries;
+    size_t nearest;
+    double selectivity;
+    uint32_t seed;
+    bool shuffle;
+};
+
+struct bench_result
+{
+    double build_seconds;
+    uint64_t index_bytes;
+    double range_ms;
+    double range_hits;
+    double range_runs;
+    double nearest_ms;
+};
+
+double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Visit the files of a dataset, which share its name followed by an
+// extension.
+
+template <typename F>
+void for_each_dataset_file(const std::string& file, F f)
+{
+    size_t sep = file.find_last_of('/');
+
+    std::string dir = sep == std::string::npos ? "." : file.substr(0, sep);
+    std::string prefix = (sep == std::string::npos ? file :
+        file.substr(sep + 1)) + ".";
+
+    DIR* d = opendir(dir.c_str());
+
+    if (d == 0)
+        throw std::runtime_error("Failed to list " + dir + "!");
+
+    std::vector<std::string> names;
+
+    for (struct dirent* e = readdir(d); e != 0; e = readdir(d))
+    {
+        if (std::strncmp(e->d_name, prefix.c_str(), prefix.size()) == 0)
+            names.push_back(e->d_name);
+    }
+
+    closedir(d);
+
+    for (size_t i = 0; i < names.size(); i++)
+        f(dir + "/" + names[i], names[i].substr(prefix.size()));
+}
+
+// Count the runs of contiguous pages of the data file holding the data
+// of a set of traces, which is how many separate reads extracting them
+// needs.
+
+size_t count_data_runs(
+    std::vector<std::pair<const char*, size_t> >& data
+)
+{
+    const uintptr_t page = 4096;
+
+    std::sort(data.begin(), data.end());
+
+    size_t runs = 0;
+    uintptr_t last = 0;
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        uintptr_t first = reinterpret_cast<uintptr_t>(data[i].first) / page;
+
+        if (runs == 0 || first > last + 1)
+            runs++;
+
+        uintptr_t end = (reinterpret_cast<uintptr_t>(data[i].first) +
+            std::max<size_t>(data[i].second, 1) - 1) / page;
+
+        last = std::max(last, end);
+    }
+
+    return runs;
+}
+
+// Sum the size of every file of a dataset except the trace data, which
+// is the same for all layouts.
+
+struct index_size_counter
+{
+    uint64_t* total;
+
+    void operator()(const std::string& path, const std::string& ext) const
+    {
+        struct stat st;
+
+        if (ext != "data" && stat(path.c_str(), &st) == 0)
+            *total += static_cast<uint64_t>(st.st_size);
+    }
+};
+
+struct dataset_file_remover
+{
+    void operator()(const std::string& path, const std::string&) const
+    {
+        std::remove(path.c_str());
+    }
+};
+
+// Build a single-slot dataset from the headers with a layout and time
+// its creation and queries. The queries are centered at the locations of
+// random traces, so they follow the distribution of the survey: boxes
+// covering a fraction of the extent of the layout and k nearest
+// searches. The range queries also count the runs of the data file they
+// touch, which shows whether the data follows the order of the index.
+
+template <typename helper>
+bench_result bench_layout(
+    const std::vector<s1o_example::io::trace_header>& headers,
+    const std::string& file,
+    const bench_options& options
+)
+{
+    using namespace s1o_example::io;
+
+    typedef typename dataset_layout<helper>::type dataset_type;
+    typedef typename dataset_type::spatial_point_type point;
+    typedef typename dataset_type::elem_q_iterator_slot dataset_iterator;
+    typedef boost::geometry::model::box<point> box;
+
+    const unsigned int ndims = helper::num_spatial_dims;
+
+    bench_result result;
+
+    double t0 = now_seconds();
+
+    {
+        dataset_type outds(file, 0, 1, headers.begin(), headers.end());
+
+        outds.sync_metadata();
+        outds.sync_data();
+    }
+
+    result.build_seconds = now_seconds() - t0;
+
+    result.index_bytes = 0;
+    index_size_counter counter = { &result.index_bytes };
+    for_each_dataset_file(file, counter);
+
+    dataset_type inds(file, 0, s1o::S1O_FLAGS_ALLOW_UNSORTED |
+        s1o::S1O_FLAGS_NO_DATA_CHECK, 1);
+
+    const typename dataset_type::meta_adapter_type& meta_adapter =
+        inds.get_meta_adapter();
+
+    // The sides of the query boxes are scaled so their volume is the
+    // requested fraction of the extent.
+
+    box extent;
+    boost::geometry::assign_inverse(extent);
+
+    for (size_t i = 0; i < headers.size(); i++)
+    {
+        point location;
+        meta_adapter.get_location(headers[i], location);
+        boost::geometry::expand(extent, location);
+    }
+
+    point half = extent.max_corner();
+    boost::geometry::subtract_point(half, extent.min_corner());
+    boost::geometry::multiply_value(half,
+        std::pow(options.selectivity, 1.0 / ndims) / 2);
+
+    boost::random::mt19937 rng(options.seed);
+    boost::random::uniform_int_distribution<size_t> pick(0,
+        headers.size() - 1);
+
+    size_t hits = 0;
+    size_t runs = 0;
+    double elapsed = 0;
+
+    std::vector<std::pair<const char*, size_t> > data;
+
+    for (size_t q = 0; q < options.nqueries; q++)
+    {
+        point p1, p2;
+        meta_adapter.get_location(headers[pick(rng)], p1);
+        p2 = p1;
+
+        boost::geometry::subtract_point(p1, half);
+        boost::geometry::add_point(p2, half);
+
+        data.clear();
+
+        t0 = now_seconds();
+
+        dataset_iterator begin = inds.begin_query_elements(p1, p2, 0);
+        dataset_iterator end = inds.end_query_elements(0);
+
+        for (; begin != end; begin++)
+        {
+            data.push_back(std::make_pair(begin->second,
+                meta_adapter.get_data_size(*begin->first)));
+        }
+
+        elapsed += now_seconds() - t0;
+
+        hits += data.size();
+        runs += count_data_runs(data);
+    }
+
+    result.range_ms = elapsed * 1000 / options.nqueries;
+    result.range_hits = static_cast<double>(hits) / options.nqueries;
+    result.range_runs = static_cast<double>(runs) / options.nqueries;
+
+    hits = 0;
+    t0 = now_seconds();
+
+    for (size_t q = 0; q < options.nqueries; q++)
+    {
+        point p;
+        meta_adapter.get_location(headers[pick(rng)], p);
+
+        dataset_iterator begin = inds.begin_query_elements(p,
+            options.nearest, 0);
+        dataset_iterator end = inds.end_query_elements(0);
+
+        for (; begin != end; begin++)
+            hits++;
+    }
+
+    result.nearest_ms = (now_seconds() - t0) * 1000 / options.nqueries;
+
+    for_each_dataset_file(file, dataset_file_remover());
+
+    return result;
+}
+
+template <typename helper>
+void run_layout(
+    const std::string& name,
+    const std::vector<s1o_example::io::trace_header>& headers,
+    const std::string& prefix,
+    const bench_options& options
+)
+{
+    std::cerr
+        << "Benchmarking layout "
+        << name
+        << "..."
+        << std::endl;
+
+    bench_result r = bench_layout<helper>(headers, prefix + "_" + name,
+        options);
+
+    std::cout
+        << std::left << std::setw(8) << name << std::right
+        << std::setw(6) << helper::num_spatial_dims
+        << std::fixed
+        << std::setw(12) << std::setprecision(3) << r.build_seconds
+        << std::setw(12) << std::setprecision(2)
+        << r.index_bytes / (1024.0 * 1024.0)
+        << std::setw(12) << std::setprecision(3) << r.range_ms
+        << std::setw(12) << std::setprecision(1) << r.range_hits
+        << std::setw(12) << std::setprecision(1) << r.range_runs
+        << std::setw(12) << std::setprecision(3) << r.nearest_ms
+        << std::endl;
+}
+
+}
+
+// This program compares the spatial layouts of the traces by building a
+// dataset with each of them from the headers of a SU file and timing
+// range and nearest queries on it. With -s the headers are shuffled
+// before building, so if the data followed the order of the input rather
+// than the index, the range queries would touch many more runs.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    // Parse the optional number of queries, number of nearest traces,
+    // fraction of the extent covered by the range queries and seed.
+
+    bench_options options;
+    options.nqueries = 1000;
+    options.nearest = 16;
+    options.selectivity = 0.001;
+    options.seed = 1;
+    options.shuffle = false;
+
+    int argi = 1;
+
+    while (argc - argi > 2)
+    {
+        if (std::strcmp(argv[argi], "-s") == 0)
+        {
+            options.shuffle = true;
+            argi += 1;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-q") == 0)
+            options.nqueries = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-k") == 0)
+            options.nearest = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-f") == 0)
+            options.selectivity = boost::lexical_cast<double>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-r") == 0)
+            options.seed = boost::lexical_cast<uint32_t>(argv[argi + 1]);
+        else
+            break;
+
+        argi += 2;
+    }
+
+    if (argc - argi != 2 || options.nqueries == 0 ||
+        options.selectivity <= 0 || options.selectivity > 1)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-q nqueries] [-k nearest] [-f fraction] "
+            << "[-r seed] [-s] sufile prefix"
+            << std::endl;
+        return 1;
+    }
+
+    std::string infile(argv[argi]);
+    std::string prefix(argv[argi + 1]);
+
+    std::cerr
+        << "Reading trace headers from "
+        << infile
+        << "..."
+        << std::endl;
+
+    std::vector<trace_header> headers;
+
+    {
+        su_input_dataset inds(infile);
+
+        trace_header header;
+        uint64_t id = 1;
+
+        while (inds.read_trace_header(header))
+        {
+            header.Id = id++;
+            headers.push_back(header);
+        }
+    }
+
+    // The ids are numbered again after shuffling, so they still follow
+    // the order the headers are given in.
+
+    if (options.shuffle)
+    {
+        boost::random::mt19937 rng(options.seed);
+
+        for (size_t i = headers.size(); i > 1; i--)
+        {
+            boost::random::uniform_int_distribution<size_t> pick(0, i - 1);
+            std::swap(headers[i - 1], headers[pick(rng)]);
+        }
+
+        for (size_t i = 0; i < headers.size(); i++)
+            headers[i].Id = i + 1;
+    }
+
+    if (headers.size() == 0)
+        throw std::runtime_error("The input file has no headers!");
+
+    std::cerr
+        << "Read "
+        << headers.size()
+        << " headers."
+        << std::endl;
+
+    std::cout
+        << std::left << std::setw(8) << "layout" << std::right
+        << std::setw(6) << "dims"
+        << std::setw(12) << "build_s"
+        << std::setw(12) << "index_mib"
+        << std::setw(12) << "range_ms"
+        << std::setw(12) << "range_hits"
+        << std::setw(12) << "range_runs"
+        << std::setw(12) << "knn_ms"
+        << std::endl;
+
+    run_layout<trace_header_helper_mhxy>("mhxy", headers, prefix, options);
+    run_layout<trace_header_helper_srxy>("srxy", headers, prefix, options);
+    run_layout<trace_header_helper_mhaz>("mhaz", headers, prefix, options);
+    run_layout<trace_header_helper_mho>("mho", headers, prefix, options);
+    run_layout<trace_header_helper_cdpoff>("cdpoff", headers, prefix,
+        options);
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/trace_header.hpp"
+#include "hpg/su.hpp"
+#include "hpg/su_mmap.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <time.h>
+
+namespace {
+
+struct bench_options
+{
+    size_t repeats;
+    size_t buffer_mib;
+};
+
+double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Destination of the samples, standing for the slot of the dataset. The
+// traces are written one after the other, wrapping around when the next
+// trace does not fit, so large files can be read with a bounded buffer.
+
+class sample_buffer
+{
+private:
+
+    typedef s1o_example::io::sample_t sample_t;
+
+    std::vector<sample_t> samples;
+    size_t used;
+
+public:
+
+    sample_buffer(size_t size) :
+        samples(size),
+        used(0)
+    {
+    }
+
+    sample_t* next(unsigned int ns)
+    {
+        if (used + ns > samples.size())
+            used = 0;
+
+        sample_t* p = &samples[used];
+        used += ns;
+
+        return p;
+    }
+};
+
+// Read the samples to a vector owned by the reader and copy them to the
+// destination, as su2s1o did before reading to the slot directly.
+// Returns the bytes of samples read.
+
+template <typename R>
+uint64_t read_staged(
+    const std::string& infile,
+    sample_buffer& buffer
+)
+{
+    using namespace s1o_example::io;
+
+    R inds(infile);
+
+    trace_header header;
+    std::vector<sample_t> insamples;
+    uint64_t nsamples = 0;
+
+    while (inds.read_trace(header, insamples))
+    {
+        std::copy(insamples.begin(), insamples.end(),
+            buffer.next(header.Ns));
+
+        nsamples += header.Ns;
+    }
+
+    return nsamples * sizeof(sample_t);
+}
+
+// Read the samples straight to the destination. Returns the bytes of
+// samples read.
+
+template <typename R>
+uint64_t read_direct(
+    const std::string& infile,
+    sample_buffer& buffer,
+    unsigned int max_ns
+)
+{
+    using namespace s1o_example::io;
+
+    R inds(infile);
+
+    trace_header header;
+    uint64_t nsamples = 0;
+
+    while (inds.read_trace(header, buffer.next(max_ns), max_ns))
+        nsamples += header.Ns;
+
+    return nsamples * sizeof(sample_t);
+}
+
+// Scan and decode the headers in batches, skipping the samples, as
+// su2s1o does before building the index. Returns the bytes of the file
+// scanned.
+
+template <typename R>
+uint64_t read_headers(const std::string& infile)
+{
+    using namespace s1o_example::io;
+
+    R inds(infile);
+
+    std::vector<trace_header> batch(16 * su_dataset::su_decode_block);
+    uint64_t nbytes = 0;
+    size_t m;
+
+    do
+    {
+        m = inds.read_trace_headers(&batch[0], batch.size());
+
+        for (size_t i = 0; i < m; i++)
+        {
+            nbytes += su_dataset::su_header_size +
+                sizeof(sample_t) * batch[i].Ns;
+        }
+    }
+    while (m == batch.size());
+
+    return nbytes;
+}
+
+// Run a path several times and print the fastest run.
+
+template <typename R>
+void run_path(
+    const std::string& backend,
+    const std::string& path,
+    const std::string& infile,
+    unsigned int max_ns,
+    sample_buffer& buffer,
+    const bench_options& options
+)
+{
+    using namespace s1o_example::io;
+
+    double best = 0;
+    uint64_t nbytes = 0;
+
+    for (size_t i = 0; i < options.repeats; i++)
+    {
+        double t0 = now_seconds();
+
+        if (path == "headers")
+            nbytes = read_headers<R>(infile);
+        else if (path == "staged")
+            nbytes = read_staged<R>(infile, buffer);
+        else
+            nbytes = read_direct<R>(infile, buffer, max_ns);
+
+        double t = now_seconds() - t0;
+
+        best = i == 0 ? t : std::min(best, t);
+    }
+
+    double mib = nbytes / (1024.0 * 1024.0);
+
+    std::cout
+        << backend << "\t" << path << "\t"
+        << std::fixed << std::setprecision(6) << best << "\t"
+        << std::setprecision(1) << (best > 0 ? mib / best : 0)
+        << std::endl;
+}
+
+}
+
+// This program measures the bandwidth of reading the samples of a SU file
+// with each reader backend, either staged through an intermediate vector
+// or directly to the destination buffer, which is how su2s1o copies the
+// samples to the slots of the dataset, and of scanning its headers.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    bench_options options;
+    options.repeats = 5;
+    options.buffer_mib = 256;
+
+    int argi = 1;
+
+    while (argc - argi > 1)
+    {
+        if (std::strcmp(argv[argi], "-r") == 0)
+            options.repeats = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-m") == 0)
+            options.buffer_mib = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else
+            break;
+
+        argi += 2;
+    }
+
+    if (argc - argi != 1 || options.repeats == 0 || options.buffer_mib == 0)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-r repeats] [-m buffer_mib] sufile"
+            << std::endl;
+        return 1;
+    }
+
+    std::string infile(argv[argi]);
+
+    // Find the largest trace, so every trace fits the destination.
+
+    unsigned int max_ns = 0;
+
+    {
+        su_dataset inds(infile);
+        trace_header header;
+
+        while (inds.read_trace_header(header))
+            max_ns = std::max(max_ns, static_cast<unsigned int>(header.Ns));
+    }
+
+    size_t buffer_size = std::max<size_t>(options.buffer_mib * 1024 * 1024 /
+        sizeof(sample_t), max_ns);
+
+    sample_buffer buffer(buffer_size);
+
+    std::cout
+        << "backend\tpath\tseconds\tmib_per_s"
+        << std::endl;
+
+    run_path<su_dataset>("fstream", "headers", infile, max_ns, buffer,
+        options);
+    run_path<su_dataset>("fstream", "staged", infile, max_ns, buffer,
+        options);
+    run_path<su_dataset>("fstream", "direct", infile, max_ns, buffer,
+        options);
+    run_path<su_dataset_mmap>("mmap", "headers", infile, max_ns, buffer,
+        options);
+    run_path<su_dataset_mmap>("mmap", "staged", infile, max_ns, buffer,
+        options);
+    run_path<su_dataset_mmap>("mmap", "direct", infile, max_ns, buffer,
+        options);
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+#!/bin/sh
+#
+# Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+#
+# This file is part of s1o_example.
+#
+# s1o_example is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# s1o_example is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU Make; see the file COPYING.  If not, write to
+# the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+
+# Generate a synthetic survey, pack it, extract a slot and run range,
+# nearest and exact queries at several selectivities. Each step is run
+# several times and the fastest run is kept. The results are written to
+# stdout as tab-separated lines with the name of the step, the time in
+# seconds and the number of traces, and are compared with a baseline
+# in the same format when one is given.
+
+set -e
+
+usage()
+{
+    echo "USAGE: $0 [-n ntraces] [-s ns] [-g 'su_synth args'] [-r repeats]" \
+        "[-f 'fractions'] [-b baseline] [-t tolerance] bindir workdir" \
+        "> results.tsv" >&2
+    exit 1
+}
+
+ntraces=100000
+ns=1000
+synth_args=
+repeats=3
+fractions="0.001 0.01 0.1"
+baseline=
+tolerance=0.1
+
+while getopts "n:s:g:r:f:b:t:" opt; do
+    case "$opt" in
+        n) ntraces=$OPTARG ;;
+        s) ns=$OPTARG ;;
+        g) synth_args=$OPTARG ;;
+        r) repeats=$OPTARG ;;
+        f) fractions=$OPTARG ;;
+        b) baseline=$OPTARG ;;
+        t) tolerance=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+[ $# -eq 2 ] || usage
+
+bindir=$1
+workdir=$2
+
+survey="$workdir/survey.su"
+pack="$workdir/survey-pack"
+log="$workdir/bench.log"
+results="$workdir/results.tsv"
+
+mkdir -p "$workdir"
+
+# Find a program either in the build directory or in its subdirectories.
+
+find_program()
+{
+    for dir in "$bindir" "$bindir/src" "$bindir/bench"; do
+        if [ -x "$dir/$1" ]; then
+            echo "$dir/$1"
+            return
+        fi
+    done
+
+    echo "Error: $1 not found in $bindir!" >&2
+    exit 1
+}
+
+su_synth=$(find_program su_synth)
+su2s1o=$(find_program su2s1o)
+s1o2su=$(find_program s1o2su)
+s1o2su_q=$(find_program s1o2su_q)
+
+now()
+{
+    date +%s.%N
+}
+
+# Run a step repeatedly, keeping the fastest time and the number of
+# traces reported by the last run.
+
+run_step()
+{
+    name=$1
+    shift
+
+    best=
+    i=0
+
+    while [ "$i" -lt "$repeats" ]; do
+        t0=$(now)
+
+        if ! "$@" > /dev/null 2> "$log"; then
+            cat "$log" >&2
+            exit 1
+        fi
+
+        t1=$(now)
+
+        best=$(echo "$t0 $t1 $best" | awk '{
+            t = $2 - $1;
+            if ($3 != "" && $3 < t) t = $3;
+            printf "%.6f", t }')
+
+        i=$((i + 1))
+    done
+
+    traces=$(sed -n 's/^Copied \([0-9]*\) traces.*/\1/p' "$log" | tail -n 1)
+
+    printf '%s\t%s\t%s\n' "$name" "$best" "${traces:-0}" >> "$results"
+
+    echo "$name: $best s, ${traces:-0} traces" >&2
+}
+
+echo "Generating $ntraces traces with $ns samples..." >&2
+
+# shellcheck disable=SC2086
+eval "$("$su_synth" -n "$ntraces" -s "$ns" $synth_args "$survey")"
+
+printf 'name\tseconds\ttraces\n' > "$results"
+
+# Both slots share the survey, which only changes the size of the data
+# file.
+
+run_step pack "$su2s1o" "$survey" "$survey" "$pack"
+run_step extract "$s1o2su" "$pack" 2 0
+
+# The queries are built in the coordinates of the layout su_synth was
+# built with, which is the layout of the other programs.
+
+run_step at "$s1o2su_q" "$pack" 2 0 "at,$layout_mid"
+
+for f in $fractions; do
+
+    # A box around the center of the survey covering the fraction of the
+    # extent of the first two coordinates of the layout (the midpoints,
+    # or the sources for srxy), or of the first one for 2D layouts, with
+    # the other coordinates unbounded.
+
+    box=$(echo "$layout_min $layout_max $layout_dims $f" | awk '{
+        n = split($1, lo, ","); split($2, hi, ",");
+        nbox = $3 > 2 ? 2 : 1;
+        s = ($4 ^ (1 / nbox)) / 2;
+        for (i = 1; i <= n; i++) {
+            if (i <= nbox) {
+                c = (lo[i] + hi[i]) / 2; h = (hi[i] - lo[i]) * s;
+                printf "%s%.9g:%.9g", (i > 1 ? "," : ""), c - h, c + h;
+            } else {
+                printf ",:";
+            }
+        } }')
+
+    k=$(echo "$ntraces $f" | awk '{
+        k = int($1 * $2); if (k < 1) k = 1; print k }')
+
+    run_step "range_$f" "$s1o2su_q" "$pack" 2 0 "range,$box"
+    run_step "nearest_$f" "$s1o2su_q" "$pack" 2 0 "nearest,$layout_mid,$k"
+done
+
+cat "$results"
+
+# Compare the times with the baseline, failing when a step is slower
+# than allowed by the tolerance.
+
+if [ -n "$baseline" ]; then
+    awk -F '\t' -v tol="$tolerance" '
+        NR == FNR { if (FNR > 1) base[$1] = $2; next }
+        FNR == 1 { next }
+        {
+            if (!($1 in base)) {
+                printf "%s: not in the baseline\n", $1 > "/dev/stderr";
+                next;
+            }
+            ratio = base[$1] > 0 ? $2 / base[$1] : 1;
+            status = ratio > 1 + tol ? "REGRESSION" : "ok";
+            if (status != "ok") failed = 1;
+            printf "%s: %.6f s vs %.6f s (%.2fx) %s\n", $1, $2, base[$1],
+                ratio, status > "/dev/stderr";
+        }
+        END { exit failed }' "$baseline" "$results"
+fi
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/trace_header.hpp"
+#include "hpg/dataset_5d.hpp"
+#include "hpg/su.hpp"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include <stdint.h>
+
+namespace {
+
+// A location in the coordinates of the layout the programs are built
+// with, filled by the helper of the layout.
+
+struct layout_point
+{
+    double coords[s1o_example::io::dataset_5d_helper::num_spatial_dims];
+
+    template <unsigned int I, typename T>
+    void set(const T& value)
+    {
+        coords[I] = value;
+    }
+};
+
+// Print the coordinates of a location separated by commas, rounded to
+// the float stored by the index so exact queries match.
+
+std::string format_location(const layout_point& p)
+{
+    std::ostringstream out;
+
+    out << std::setprecision(9);
+
+    for (unsigned int i = 0;
+        i < s1o_example::io::dataset_5d_helper::num_spatial_dims; i++)
+    {
+        out << (i != 0 ? "," : "") << static_cast<float>(p.coords[i]);
+    }
+
+    return out.str();
+}
+
+// Parameters of the synthetic survey. The shots are laid along lines,
+// each one recorded by a patch of receivers centered at the shot.
+
+struct survey_options
+{
+    size_t ntraces;
+    unsigned int ns;
+    double dt;
+    size_t patch[2];
+    double receiver_spacing[2];
+    size_t shots_per_line;
+    double shot_spacing[2];
+    double noise;
+    uint32_t seed;
+};
+
+// A flat reflector with a hyperbolic moveout.
+
+struct event
+{
+    double t0;
+    double velocity;
+    double amplitude;
+};
+
+const double ricker_frequency = 25.0;
+
+double ricker(double t)
+{
+    double a = M_PI * ricker_frequency * t;
+    a *= a;
+    return (1 - 2 * a) * std::exp(-a);
+}
+
+void parse_pair(const char* arg, double* out)
+{
+    std::string s(arg);
+    size_t sep = s.find(':');
+
+    if (sep == std::string::npos)
+        throw std::runtime_error("Expected a pair as a:b, got " + s + "!");
+
+    out[0] = boost::lexical_cast<double>(s.substr(0, sep));
+    out[1] = boost::lexical_cast<double>(s.substr(sep + 1));
+}
+
+void parse_pair(const char* arg, size_t* out)
+{
+    double values[2];
+    parse_pair(arg, values);
+
+    out[0] = static_cast<size_t>(values[0]);
+    out[1] = static_cast<size_t>(values[1]);
+}
+
+}
+
+// This program writes a synthetic SU survey with a regular geometry and
+// a few reflections plus random noise. The same parameters and seed
+// always produce the same file. The extent of the midpoints and the
+// coordinates of the middle trace are printed to stdout as shell
+// variables, so scripts can build queries for the survey.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    survey_options options;
+    options.ntraces = 100000;
+    options.ns = 1000;
+    options.dt = 0.004;
+    options.patch[0] = 48;
+    options.patch[1] = 8;
+    options.receiver_spacing[0] = 25;
+    options.receiver_spacing[1] = 50;
+    options.shots_per_line = 40;
+    options.shot_spacing[0] = 50;
+    options.shot_spacing[1] = 200;
+    options.noise = 0.1;
+    options.seed = 1;
+
+    int argi = 1;
+
+    while (argc - argi > 1)
+    {
+        if (std::strcmp(argv[argi], "-n") == 0)
+            options.ntraces = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-s") == 0)
+            options.ns = boost::lexical_cast<unsigned int>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-t") == 0)
+            options.dt = boost::lexical_cast<double>(argv[argi + 1]) / 1e6;
+        else if (std::strcmp(argv[argi], "-p") == 0)
+            parse_pair(argv[argi + 1], options.patch);
+        else if (std::strcmp(argv[argi], "-g") == 0)
+            parse_pair(argv[argi + 1], options.receiver_spacing);
+        else if (std::strcmp(argv[argi], "-l") == 0)
+            options.shots_per_line = boost::lexical_cast<size_t>(
+                argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-d") == 0)
+            parse_pair(argv[argi + 1], options.shot_spacing);
+        else if (std::strcmp(argv[argi], "-e") == 0)
+            options.noise = boost::lexical_cast<double>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-r") == 0)
+            options.seed = boost::lexical_cast<uint32_t>(argv[argi + 1]);
+        else
+            break;
+
+        argi += 2;
+    }
+
+    if (argc - argi != 1 || options.ntraces == 0 || options.ns == 0 ||
+        options.ns > 65535 || options.patch[0] == 0 ||
+        options.patch[1] == 0 || options.shots_per_line == 0)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-n ntraces] [-s ns] [-t dt_us] "
+            << "[-p nrx:nry] [-g drx:dry] [-l shots_per_line] "
+            << "[-d dsx:dsy] [-e noise] [-r seed] sufile"
+            << std::endl;
+        return 1;
+    }
+
+    std::string outfile(argv[argi]);
+
+    std::ofstream out(outfile.c_str(), std::ios::binary);
+
+    if (!out.is_open())
+        throw std::runtime_error("Failed to open " + outfile + "!");
+
+    // The reflectors are placed at fixed fractions of the record.
+
+    double tmax = options.ns * options.dt;
+
+    event events[3] = {
+        { 0.3 * tmax, 1800.0,  1.0 },
+        { 0.5 * tmax, 2400.0, -0.7 },
+        { 0.7 * tmax, 3000.0,  0.5 },
+    };
+
+    // The wavelet is only evaluated close to its peak.
+
+    const int half_width = static_cast<int>(std::ceil(
+        1.5 / (ricker_frequency * options.dt)));
+
+    size_t traces_per_shot = options.patch[0] * options.patch[1];
+    size_t nshots = (options.ntraces + traces_per_shot - 1) /
+        traces_per_shot;
+    size_t nlines = (nshots + options.shots_per_line - 1) /
+        options.shots_per_line;
+
+    // The receivers before the shot in the patch, and the extent of the
+    // receivers around the shot.
+
+    size_t before[2];
+    double rmin[2];
+    double rmax[2];
+    double bin[2];
+
+    for (int d = 0; d < 2; d++)
+    {
+        before[d] = options.patch[d] / 2;
+        rmin[d] = -static_cast<double>(before[d]) *
+            options.receiver_spacing[d];
+        rmax[d] = (options.patch[d] - 1 - before[d]) *
+            options.receiver_spacing[d];
+        bin[d] = options.receiver_spacing[d] / 2;
+    }
+
+    // The CDP is the number of the midpoint bin, counted along x first.
+
+    double mmin[2] = { rmin[0] / 2, rmin[1] / 2 };
+    double mmax[2] = {
+        (options.shots_per_line - 1) * options.shot_spacing[0] + rmax[0] / 2,
+        (nlines - 1) * options.shot_spacing[1] + rmax[1] / 2
+    };
+
+    int32_t nbins_x = static_cast<int32_t>((mmax[0] - mmin[0]) / bin[0]) + 1;
+
+    boost::random::mt19937 rng(options.seed);
+    boost::random::normal_distribution<double> normal(0, options.noise);
+
+    std::vector<sample_t> samples(options.ns);
+
+    trace_header middle;
+
+    // The extent of the traces in the coordinates of the layout.
+
+    const unsigned int ndims = dataset_5d_helper::num_spatial_dims;
+
+    layout_point lmin;
+    layout_point lmax;
+
+    for (unsigned int i = 0; i < ndims; i++)
+    {
+        lmin.coords[i] = std::numeric_limits<double>::max();
+        lmax.coords[i] = -std::numeric_limits<double>::max();
+    }
+
+    for (size_t id = 1; id <= options.ntraces; id++)
+    {
+        size_t k = id - 1;
+        size_t shot = k / traces_per_shot;
+        size_t receiver = k % traces_per_shot;
+
+        double sx = (shot % options.shots_per_line) * options.shot_spacing[0];
+        double sy = (shot / options.shots_per_line) * options.shot_spacing[1];
+        double rx = sx + rmin[0] + (receiver % options.patch[0]) *
+            options.receiver_spacing[0];
+        double ry = sy + rmin[1] + (receiver / options.patch[0]) *
+            options.receiver_spacing[1];
+
+        double mx = (sx + rx) / 2;
+        double my = (sy + ry) / 2;
+        double offset = std::sqrt((rx - sx) * (rx - sx) +
+            (ry - sy) * (ry - sy));
+
+        trace_header header;
+
+        header.Id = id;
+        header.CDP = 1 + static_cast<int32_t>((mx - mmin[0]) / bin[0]) +
+            static_cast<int32_t>((my - mmin[1]) / bin[1]) * nbins_x;
+        header.Offset = offset;
+        header.SrcX = sx;
+        header.SrcY = sy;
+        header.RcvX = rx;
+        header.RcvY = ry;
+        header.Delrt = 0;
+        header.Ns = options.ns;
+        header.Dt = options.dt;
+
+        for (size_t i = 0; i < samples.size(); i++)
+            samples[i] = static_cast<sample_t>(options.noise != 0 ?
+                normal(rng) : 0);
+
+        for (int e = 0; e < 3; e++)
+        {
+            double to = offset / events[e].velocity;
+            double t = std::sqrt(events[e].t0 * events[e].t0 + to * to);
+            int center = static_cast<int>(t / options.dt + 0.5);
+
+            for (int i = std::max(center - half_width, 0);
+                i <= center + half_width && i < static_cast<int>(options.ns);
+                i++)
+            {
+                samples[i] += static_cast<sample_t>(events[e].amplitude *
+                    ricker(i * options.dt - t));
+            }
+        }
+
+        // Keep the middle trace as it is read back, since SU stores the
+        // coordinates as scaled integers.
+
+        char raw[su_dataset::su_header_size];
+
+        su_dataset::encode_header(header, raw);
+
+        trace_header stored;
+        su_dataset::decode_header(raw, id, stored);
+
+        if (id == (options.ntraces + 1) / 2)
+            middle = stored;
+
+        layout_point location;
+        dataset_5d_helper::get_location(stored, location);
+
+        for (unsigned int i = 0; i < ndims; i++)
+        {
+            lmin.coords[i] = std::min(lmin.coords[i], location.coords[i]);
+            lmax.coords[i] = std::max(lmax.coords[i], location.coords[i]);
+        }
+
+        out.write(raw, su_dataset::su_header_size);
+
+        out.write(reinterpret_cast<const char*>(&samples[0]),
+            samples.size() * sizeof(sample_t));
+    }
+
+    out.close();
+
+    if (!out)
+        throw std::runtime_error("Failed to write " + outfile + "!");
+
+    std::cout
+        << std::setprecision(9)
+        << "ntraces=" << options.ntraces << std::endl
+        << "mx_min=" << mmin[0] << std::endl
+        << "mx_max=" << mmax[0] << std::endl
+        << "my_min=" << mmin[1] << std::endl
+        << "my_max=" << mmax[1] << std::endl
+        << "mid_mx=" << (middle.SrcX + middle.RcvX) / 2 << std::endl
+        << "mid_my=" << (middle.SrcY + middle.RcvY) / 2 << std::endl
+        << "mid_hx=" << (middle.RcvX - middle.SrcX) / 2 << std::endl
+        << "mid_hy=" << (middle.RcvY - middle.SrcY) / 2 << std::endl;
+
+    layout_point mid;
+    dataset_5d_helper::get_location(middle, mid);
+
+    std::cout
+        << "layout_dims=" << ndims << std::endl
+        << "layout_min=" << format_location(lmin) << std::endl
+        << "layout_max=" << format_location(lmax) << std::endl
+        << "layout_mid=" << format_location(mid) << std::endl;
+
+    return 0;
+}
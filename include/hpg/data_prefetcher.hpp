@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Ask the kernel to start reading regions of a memory-mapped file that
+// will be accessed soon, so the page faults of the consumer find the data
+// already in the page cache. Consecutive regions are merged into a single
+// request, so traces stored next to each other cost one system call.
+
+class data_prefetcher
+{
+private:
+
+    uintptr_t page_mask;
+    uintptr_t pending_begin;
+    uintptr_t pending_end;
+
+public:
+
+    data_prefetcher() :
+        page_mask(0),
+        pending_begin(0),
+        pending_end(0)
+    {
+        long page_size = sysconf(_SC_PAGESIZE);
+
+        page_mask = ~static_cast<uintptr_t>((page_size > 0 ?
+            page_size : 4096) - 1);
+    }
+
+    ~data_prefetcher()
+    {
+        flush();
+    }
+
+    // Queue a region to be prefetched.
+
+    void advise(const char* data, size_t size)
+    {
+        if (size == 0)
+            return;
+
+        uintptr_t begin = reinterpret_cast<uintptr_t>(data) & page_mask;
+        uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size +
+            ~page_mask) & page_mask;
+
+        if (pending_begin != pending_end &&
+            begin <= pending_end && end >= pending_begin)
+        {
+            pending_begin = std::min(pending_begin, begin);
+            pending_end = std::max(pending_end, end);
+            return;
+        }
+
+        flush();
+
+        pending_begin = begin;
+        pending_end = end;
+    }
+
+    // Issue the request for the queued regions. This is only a hint, so
+    // failures are ignored.
+
+    void flush()
+    {
+        if (pending_begin == pending_end)
+            return;
+
+        madvise(reinterpret_cast<void*>(pending_begin),
+            pending_end - pending_begin, MADV_WILLNEED);
+
+        pending_begin = 0;
+        pending_end = 0;
+    }
+};
+
+}}
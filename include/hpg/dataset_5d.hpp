@@ -22,10 +22,18 @@
 
 #include "trace_header.hpp"
 #include "trace_header_adapter_mhxy.hpp"
+#include "trace_header_adapter_srxy.hpp"
+#include "trace_header_adapter_mhaz.hpp"
+#include "trace_header_adapter_mho.hpp"
+#include "trace_header_adapter_cdpoff.hpp"
 
 #include <s1o/dataset.hpp>
 #include <s1o/spatial_adapters/rtree_disk_slim.hpp>
 
+#include <boost/lexical_cast.hpp>
+
+#include <string>
+
 namespace s1o_example {
 namespace io {
 
@@ -33,16 +41,130 @@ namespace detail_dataset_5d {
 
 typedef boost::geometry::index::quadratic<16> params_t;
 typedef boost::geometry::cs::cartesian coord_sys_t;
-typedef s1o::spatial_adapters::rtree_disk_slim<
-    params_t,
-    coord_sys_t
-    > rtree;
+
+template <typename params>
+struct rtree_of
+{
+    typedef s1o::spatial_adapters::rtree_disk_slim<
+        params,
+        coord_sys_t
+        > type;
+};
+
+typedef rtree_of<params_t>::type rtree;
 
 }
 
-typedef s1o::dataset<
-    trace_header_adapter_mhxy,
-    detail_dataset_5d::rtree
-    > dataset_5d;
+// Name of the split algorithm and node capacity of an rtree, such as
+// "rstar64".
+
+template <typename params>
+struct rtree_params_name;
+
+template <size_t MaxElements, size_t MinElements>
+struct rtree_params_name<
+    boost::geometry::index::linear<MaxElements, MinElements>
+    >
+{
+    static std::string get()
+    {
+        return "linear" + boost::lexical_cast<std::string>(MaxElements);
+    }
+};
+
+template <size_t MaxElements, size_t MinElements>
+struct rtree_params_name<
+    boost::geometry::index::quadratic<MaxElements, MinElements>
+    >
+{
+    static std::string get()
+    {
+        return "quadratic" + boost::lexical_cast<std::string>(MaxElements);
+    }
+};
+
+template <
+    size_t MaxElements,
+    size_t MinElements,
+    size_t ReinsertedElements,
+    size_t OverlapCostThreshold
+    >
+struct rtree_params_name<
+    boost::geometry::index::rstar<
+        MaxElements,
+        MinElements,
+        ReinsertedElements,
+        OverlapCostThreshold
+        >
+    >
+{
+    static std::string get()
+    {
+        return "rstar" + boost::lexical_cast<std::string>(MaxElements);
+    }
+};
+
+// Helper that appends the rtree parameters to the name of another
+// helper, so they are recorded in the check section of the dataset.
+
+template <typename helper, typename params>
+struct trace_header_helper_rtree : helper
+{
+    static const char* get_name()
+    {
+        static const std::string name = std::string(helper::get_name()) +
+            "/" + rtree_params_name<params>::get();
+
+        return name.c_str();
+    }
+};
+
+// The s1o dataset for a given spatial layout of the traces and rtree
+// parameters. Datasets with the default parameters keep the check of
+// the layout alone, so they open as before.
+
+template <typename helper, typename params = detail_dataset_5d::params_t>
+struct dataset_layout
+{
+    typedef s1o::dataset<
+        trace_header_adapter<trace_header_helper_rtree<helper, params> >,
+        typename detail_dataset_5d::rtree_of<params>::type
+        > type;
+};
+
+template <typename helper>
+struct dataset_layout<helper, detail_dataset_5d::params_t>
+{
+    typedef s1o::dataset<
+        trace_header_adapter<helper>,
+        detail_dataset_5d::rtree
+        > type;
+};
+
+// The layout used by the programs is selected when building. The name
+// of the layout is recorded in the check section of the dataset, so a
+// dataset is never opened with a different layout.
+
+#if defined(S1O_EXAMPLE_LAYOUT_SRXY)
+typedef trace_header_helper_srxy dataset_5d_helper;
+#elif defined(S1O_EXAMPLE_LAYOUT_MHAZ)
+typedef trace_header_helper_mhaz dataset_5d_helper;
+#elif defined(S1O_EXAMPLE_LAYOUT_MHO)
+typedef trace_header_helper_mho dataset_5d_helper;
+#elif defined(S1O_EXAMPLE_LAYOUT_CDPOFF)
+typedef trace_header_helper_cdpoff dataset_5d_helper;
+#else
+typedef trace_header_helper_mhxy dataset_5d_helper;
+#endif
+
+// The dataset of the programs with the given rtree parameters.
+
+template <typename params>
+struct dataset_5d_variant
+{
+    typedef typename dataset_layout<dataset_5d_helper, params>::type type;
+};
+
+typedef dataset_layout<dataset_5d_helper>::type dataset_5d;
 
 }}
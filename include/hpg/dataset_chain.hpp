@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "su_header_column.hpp"
+#include "dataset_5d.hpp"
+
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace s1o_example {
+namespace io {
+
+// A packed dataset can be extended by appending delta datasets, each one
+// a regular dataset_5d with its own index. The names of the deltas are
+// listed, in the order they were appended, in a text file next to the
+// base dataset. Names are stored relative to the base so the files can
+// be moved together.
+
+inline std::string get_deltas_filename(const std::string& base)
+{
+    return base + ".deltas";
+}
+
+// Read the names of the deltas appended to a base dataset. A dataset
+// without a deltas file has no deltas.
+
+inline std::vector<std::string> read_delta_names(const std::string& base)
+{
+    std::vector<std::string> names;
+
+    std::ifstream file(get_deltas_filename(base).c_str());
+
+    if (!file.is_open())
+        return names;
+
+    std::string name;
+
+    while (std::getline(file, name))
+    {
+        if (name.size() != 0)
+            names.push_back(base + "." + name);
+    }
+
+    return names;
+}
+
+// Get the name of the i-th delta of a base dataset, counting from 1,
+// relative to the base.
+
+inline std::string get_delta_name(size_t i)
+{
+    return "delta" + boost::lexical_cast<std::string>(i);
+}
+
+// Register a delta after it was completely written, so readers never
+// see a partial delta.
+
+inline void register_delta(const std::string& base, const std::string& name)
+{
+    std::string filename = get_deltas_filename(base);
+
+    std::ofstream file(filename.c_str(), std::ios_base::app);
+
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + filename + "!");
+
+    file << name << std::endl;
+
+    if (!file)
+        throw std::runtime_error("Failed to write " + filename + "!");
+}
+
+// A base dataset opened together with all of its deltas and their
+// pre-encoded header columns, when available.
+
+template <typename D>
+class dataset_chain
+{
+public:
+
+    typedef D dataset_type;
+
+private:
+
+    std::vector<std::string> _names;
+    boost::ptr_vector<D> _datasets;
+    boost::ptr_vector<su_header_column> _columns;
+
+public:
+
+    dataset_chain(const std::string& base, int flags, size_t slots)
+    {
+        _names.push_back(base);
+
+        std::vector<std::string> names = read_delta_names(base);
+
+        _names.insert(_names.end(), names.begin(), names.end());
+
+        for (size_t i = 0; i < _names.size(); i++)
+        {
+            D* ds = new D(_names[i], 0, flags, slots);
+
+            _datasets.push_back(ds);
+            _columns.push_back(new su_header_column(_names[i],
+                ds->get_max_elements()));
+        }
+    }
+
+    size_t size() const
+    {
+        return _datasets.size();
+    }
+
+    D& operator[](size_t i)
+    {
+        return _datasets[i];
+    }
+
+    const D& operator[](size_t i) const
+    {
+        return _datasets[i];
+    }
+
+    const std::string& get_name(size_t i) const
+    {
+        return _names[i];
+    }
+
+    // Get the pre-encoded header column of a dataset in the chain, or
+    // null if it is not available.
+
+    const su_header_column* get_header_column(size_t i) const
+    {
+        return _columns[i].is_available() ? &_columns[i] : 0;
+    }
+
+    size_t get_max_elements() const
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < _datasets.size(); i++)
+            n += _datasets[i].get_max_elements();
+
+        return n;
+    }
+};
+
+typedef dataset_chain<dataset_5d> dataset_5d_chain;
+
+}}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "dataset_5d.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <string>
+
+namespace s1o_example {
+namespace io {
+
+// The rtree parameters a dataset can be packed with. Small nodes suit
+// small datasets and selective queries, while large nodes keep the tree
+// shallow for datasets with billions of traces. The visitor is called
+// with each set of parameters until it returns true, and the result
+// tells if any call returned true.
+
+template <typename V>
+bool visit_rtree_variants(V& visitor)
+{
+    namespace bgi = boost::geometry::index;
+
+    return
+        visitor.template visit<bgi::quadratic<16> >() ||
+        visitor.template visit<bgi::quadratic<64> >() ||
+        visitor.template visit<bgi::quadratic<256> >() ||
+        visitor.template visit<bgi::linear<16> >() ||
+        visitor.template visit<bgi::linear<64> >() ||
+        visitor.template visit<bgi::linear<256> >() ||
+        visitor.template visit<bgi::rstar<16> >() ||
+        visitor.template visit<bgi::rstar<64> >() ||
+        visitor.template visit<bgi::rstar<256> >();
+}
+
+namespace detail_dataset_variants {
+
+template <typename F>
+struct by_name
+{
+    const std::string& name;
+    F& f;
+
+    by_name(const std::string& name, F& f) :
+        name(name),
+        f(f)
+    {
+    }
+
+    template <typename params>
+    bool visit()
+    {
+        if (rtree_params_name<params>::get() != name)
+            return false;
+
+        f.template run<typename dataset_5d_variant<params>::type>();
+        return true;
+    }
+};
+
+struct has_name
+{
+    const std::string& name;
+
+    has_name(const std::string& name) :
+        name(name)
+    {
+    }
+
+    template <typename params>
+    bool visit()
+    {
+        return rtree_params_name<params>::get() == name;
+    }
+};
+
+struct names
+{
+    std::string list;
+
+    template <typename params>
+    bool visit()
+    {
+        list += (list.size() != 0 ? ", " : "") +
+            rtree_params_name<params>::get();
+
+        return false;
+    }
+};
+
+}
+
+// Get the names of all rtree variants, separated by commas.
+
+inline std::string get_rtree_variant_names()
+{
+    detail_dataset_variants::names visitor;
+    visit_rtree_variants(visitor);
+    return visitor.list;
+}
+
+// Get the name of the rtree variant used when none is given.
+
+inline std::string get_default_rtree_variant()
+{
+    return rtree_params_name<detail_dataset_5d::params_t>::get();
+}
+
+// Ensure an rtree variant exists.
+
+inline void check_rtree_variant(const std::string& name)
+{
+    detail_dataset_variants::has_name visitor(name);
+
+    if (!visit_rtree_variants(visitor))
+    {
+        throw std::runtime_error("Unknown rtree variant " + name +
+            ", expected one of " + get_rtree_variant_names() + "!");
+    }
+}
+
+// Call f.run<D>() with the dataset type of the named rtree variant.
+
+template <typename F>
+void with_rtree_variant(const std::string& name, F& f)
+{
+    detail_dataset_variants::by_name<F> visitor(name, f);
+
+    if (!visit_rtree_variants(visitor))
+        check_rtree_variant(name);
+}
+
+// The name of the rtree variant a dataset was packed with is stored in a
+// text file next to it, since the check of s1o can only reject a wrong
+// guess. Datasets without the file use the default variant, the only
+// one before the variants existed.
+
+inline std::string get_variant_filename(const std::string& dataset)
+{
+    return dataset + ".variant";
+}
+
+inline void write_dataset_variant(
+    const std::string& file,
+    const std::string& name
+)
+{
+    std::string filename = get_variant_filename(file);
+
+    std::ofstream out(filename.c_str(), std::ios_base::trunc);
+
+    if (!out.is_open())
+        throw std::runtime_error("Failed to open " + filename + "!");
+
+    out << name << std::endl;
+
+    if (!out)
+        throw std::runtime_error("Failed to write " + filename + "!");
+}
+
+// Get the name of the rtree variant a dataset was packed with.
+
+inline std::string get_dataset_variant(const std::string& file)
+{
+    std::ifstream in(get_variant_filename(file).c_str());
+
+    if (!in.is_open())
+        return get_default_rtree_variant();
+
+    std::string name;
+    std::getline(in, name);
+
+    check_rtree_variant(name);
+
+    return name;
+}
+
+// Call f.run<D>() with the dataset type of the rtree variant a dataset
+// was packed with. Errors opening the dataset come from f.
+
+template <typename F>
+void with_dataset_variant(const std::string& file, F& f)
+{
+    with_rtree_variant(get_dataset_variant(file), f);
+}
+
+}}
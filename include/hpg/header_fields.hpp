@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace s1o_example {
+namespace io {
+
+// Access to the fields of the trace header by name, including the
+// midpoint and half-offset coordinates derived from the source and
+// receiver positions. The values are converted to double, which is
+// exact for the integer fields below 2^53.
+
+typedef double (*header_field_getter)(const trace_header& header);
+
+struct header_field
+{
+    const char* name;
+    header_field_getter get;
+};
+
+namespace detail_header_fields {
+
+inline double get_id(const trace_header& h)
+{
+    return h.Id;
+}
+
+inline double get_cdp(const trace_header& h)
+{
+    return h.CDP;
+}
+
+inline double get_offset(const trace_header& h)
+{
+    return h.Offset;
+}
+
+inline double get_src_x(const trace_header& h)
+{
+    return h.SrcX;
+}
+
+inline double get_src_y(const trace_header& h)
+{
+    return h.SrcY;
+}
+
+inline double get_rcv_x(const trace_header& h)
+{
+    return h.RcvX;
+}
+
+inline double get_rcv_y(const trace_header& h)
+{
+    return h.RcvY;
+}
+
+inline double get_delrt(const trace_header& h)
+{
+    return h.Delrt;
+}
+
+inline double get_ns(const trace_header& h)
+{
+    return h.Ns;
+}
+
+inline double get_dt(const trace_header& h)
+{
+    return h.Dt;
+}
+
+inline double get_mx(const trace_header& h)
+{
+    return (h.RcvX + h.SrcX) / 2.0;
+}
+
+inline double get_my(const trace_header& h)
+{
+    return (h.RcvY + h.SrcY) / 2.0;
+}
+
+inline double get_hx(const trace_header& h)
+{
+    return (h.RcvX - h.SrcX) / 2.0;
+}
+
+inline double get_hy(const trace_header& h)
+{
+    return (h.RcvY - h.SrcY) / 2.0;
+}
+
+}
+
+// Number of fields, the stored fields first in the order of the
+// trace_header and then the derived coordinates.
+
+const size_t num_header_fields = 14;
+
+inline const header_field& get_header_field(size_t i)
+{
+    using namespace detail_header_fields;
+
+    static const header_field fields[num_header_fields] = {
+        { "Id"    , get_id     },
+        { "CDP"   , get_cdp    },
+        { "Offset", get_offset },
+        { "SrcX"  , get_src_x  },
+        { "SrcY"  , get_src_y  },
+        { "RcvX"  , get_rcv_x  },
+        { "RcvY"  , get_rcv_y  },
+        { "Delrt" , get_delrt  },
+        { "Ns"    , get_ns     },
+        { "Dt"    , get_dt     },
+        { "mx"    , get_mx     },
+        { "my"    , get_my     },
+        { "hx"    , get_hx     },
+        { "hy"    , get_hy     }
+    };
+
+    if (i >= num_header_fields)
+        throw std::runtime_error("Header field out of range!");
+
+    return fields[i];
+}
+
+inline const header_field& find_header_field(const std::string& name)
+{
+    for (size_t i = 0; i < num_header_fields; i++)
+    {
+        const header_field& field = get_header_field(i);
+
+        if (name == field.name)
+            return field;
+    }
+
+    throw std::runtime_error("Unknown header field " + name + "!");
+}
+
+// Get the names of all fields separated by spaces.
+
+inline std::string get_header_field_names()
+{
+    std::string names;
+
+    for (size_t i = 0; i < num_header_fields; i++)
+    {
+        names += i != 0 ? " " : "";
+        names += get_header_field(i).name;
+    }
+
+    return names;
+}
+
+}}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "header_fields.hpp"
+#include "trace_header.hpp"
+#include "trace_writer.hpp"
+#include "trace_query.hpp"
+#include "query_parser.hpp"
+#include "dataset_chain.hpp"
+#include "su.hpp"
+
+#include <stdexcept>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+enum header_format
+{
+    HEADER_FORMAT_SU,
+    HEADER_FORMAT_CSV
+};
+
+inline header_format parse_header_format(const std::string& name)
+{
+    if (name == "su")
+        return HEADER_FORMAT_SU;
+
+    if (name == "csv")
+        return HEADER_FORMAT_CSV;
+
+    throw std::runtime_error("Unknown header format " + name + "!");
+}
+
+// Write only the headers of the traces to a file descriptor, either as
+// SU traces without samples (Ns set to 0) or as a CSV table with a
+// column per header field. The writer replaces the trace_writer as the
+// output of the query routines and never reads the trace data.
+
+class header_writer
+{
+private:
+
+    // Size of the CSV text buffered before it is written.
+    static const size_t batch_bytes = 1024 * 1024;
+
+    int fd;
+    header_format format;
+    trace_writer su_writer;
+    std::string text;
+    uint64_t bytes_written;
+
+    void write_text()
+    {
+        const char* p = text.data();
+        size_t remaining = text.size();
+
+        while (remaining != 0)
+        {
+            ssize_t n = write(fd, p, remaining);
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                throw std::runtime_error(
+                    "Failed to write headers to the output!");
+            }
+
+            p += n;
+            remaining -= static_cast<size_t>(n);
+        }
+
+        bytes_written += text.size();
+        text.clear();
+    }
+
+public:
+
+    header_writer(int fd, header_format format) :
+        fd(fd),
+        format(format),
+        su_writer(fd),
+        text(),
+        bytes_written(0)
+    {
+        if (format != HEADER_FORMAT_CSV)
+            return;
+
+        text.reserve(batch_bytes + 1024);
+
+        for (size_t i = 0; i < num_header_fields; i++)
+        {
+            text += i != 0 ? "," : "";
+            text += get_header_field(i).name;
+        }
+
+        text += "\n";
+    }
+
+    ~header_writer()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    uint64_t get_bytes_written() const
+    {
+        return bytes_written + su_writer.get_bytes_written();
+    }
+
+    void write_header(const trace_header& header)
+    {
+        if (format == HEADER_FORMAT_SU)
+        {
+            trace_header empty_header(header);
+
+            empty_header.Ns = 0;
+
+            su_writer.write_trace(empty_header, 0, 0);
+            return;
+        }
+
+        char value[32];
+
+        for (size_t i = 0; i < num_header_fields; i++)
+        {
+            std::snprintf(value, sizeof(value), "%s%.15g", i != 0 ?
+                "," : "", get_header_field(i).get(header));
+
+            text += value;
+        }
+
+        text += "\n";
+
+        if (text.size() >= batch_bytes)
+            write_text();
+    }
+
+    // Write all queued headers to the output.
+
+    void flush()
+    {
+        su_writer.flush();
+
+        if (text.size() != 0)
+            write_text();
+    }
+};
+
+// Queue the header of a selected trace, ignoring its data.
+
+template <typename MA>
+void copy_trace(
+    const trace_header& header,
+    const char* data,
+    const MA& meta_adapter,
+    const s1o_example::io::su_header_column* column,
+    header_writer& writer
+)
+{
+    (void)data;
+    (void)meta_adapter;
+    (void)column;
+
+    writer.write_header(header);
+}
+
+// Copy the headers of the traces selected by a query.
+
+template <typename D>
+size_t copy_headers_query(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    header_writer& writer,
+    std::ostream& log
+)
+{
+    size_t n = copy_traces_query(chain, slot, ndelta, query,
+        get_header_only_options(options), writer, log);
+
+    writer.flush();
+
+    return n;
+}
+
+}}
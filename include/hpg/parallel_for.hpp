@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace s1o_example {
+namespace misc {
+
+namespace detail {
+
+// State shared by all workers of a parallel_for call. The next index to
+// be processed is handed out under the lock so the workers form a
+// bounded pool over the indices.
+
+template <typename F>
+struct parallel_for_state
+{
+    F* f;
+    size_t n;
+    size_t next;
+    pthread_mutex_t lock;
+    std::vector<std::string> errors;
+
+    bool fetch(size_t& i)
+    {
+        pthread_mutex_lock(&lock);
+        i = next;
+        bool ok = next < n;
+        if (ok)
+            next++;
+        pthread_mutex_unlock(&lock);
+        return ok;
+    }
+};
+
+template <typename F>
+void* parallel_for_worker(void* arg)
+{
+    parallel_for_state<F>& state = *static_cast<parallel_for_state<F>*>(arg);
+
+    size_t i;
+
+    while (state.fetch(i))
+    {
+        // Exceptions cannot cross the thread boundary, so keep the
+        // message and report it after all workers are joined.
+
+        try
+        {
+            (*state.f)(i);
+        }
+        catch (const std::exception& e)
+        {
+            state.errors[i] = e.what();
+        }
+        catch (...)
+        {
+            state.errors[i] = "Unknown error!";
+        }
+    }
+
+    return 0;
+}
+
+}
+
+// Call f(i) for every i in [0, n) using at most nthreads threads. With a
+// single thread everything runs in the calling thread. Errors from the
+// workers are combined in a single exception thrown after all indices
+// were processed.
+
+template <typename F>
+void parallel_for(size_t n, size_t nthreads, F& f)
+{
+    if (nthreads > n)
+        nthreads = n;
+
+    if (nthreads <= 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            f(i);
+
+        return;
+    }
+
+    detail::parallel_for_state<F> state;
+    state.f = &f;
+    state.n = n;
+    state.next = 0;
+    state.errors.resize(n);
+    pthread_mutex_init(&state.lock, 0);
+
+    std::vector<pthread_t> threads(nthreads);
+    size_t nstarted;
+
+    for (nstarted = 0; nstarted < nthreads; nstarted++)
+    {
+        if (pthread_create(&threads[nstarted], 0,
+            detail::parallel_for_worker<F>, &state) != 0)
+            break;
+    }
+
+    // Run inline if no thread could be created, otherwise the started
+    // workers will drain the remaining indices.
+
+    if (nstarted == 0)
+        detail::parallel_for_worker<F>(&state);
+
+    for (size_t t = 0; t < nstarted; t++)
+        pthread_join(threads[t], 0);
+
+    pthread_mutex_destroy(&state.lock);
+
+    std::string message;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (state.errors[i].size() == 0)
+            continue;
+
+        message += std::string(message.size() == 0 ? "" : "\n") +
+            "[" + boost::lexical_cast<std::string>(i) + "] " +
+            state.errors[i];
+    }
+
+    if (message.size() != 0)
+        throw std::runtime_error(message);
+}
+
+}}
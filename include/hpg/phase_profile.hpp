@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include <stdexcept>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <sys/resource.h>
+#include <time.h>
+
+namespace s1o_example {
+namespace misc {
+
+// Counters of the process sampled at the boundaries of a phase. The I/O
+// counters come from /proc/self/io and are zero where it is not
+// available.
+
+struct process_counters
+{
+    double wall;
+    double user;
+    double system;
+    uint64_t minor_faults;
+    uint64_t major_faults;
+    uint64_t rchar;
+    uint64_t wchar;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+
+    process_counters() :
+        wall(0),
+        user(0),
+        system(0),
+        minor_faults(0),
+        major_faults(0),
+        rchar(0),
+        wchar(0),
+        read_bytes(0),
+        write_bytes(0)
+    {
+    }
+
+    static double to_seconds(const struct timeval& tv)
+    {
+        return tv.tv_sec + tv.tv_usec * 1e-6;
+    }
+
+    static process_counters sample()
+    {
+        process_counters c;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        c.wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            c.user = to_seconds(usage.ru_utime);
+            c.system = to_seconds(usage.ru_stime);
+            c.minor_faults = static_cast<uint64_t>(usage.ru_minflt);
+            c.major_faults = static_cast<uint64_t>(usage.ru_majflt);
+        }
+
+        std::ifstream io("/proc/self/io");
+        std::string key;
+        uint64_t value;
+
+        while (io >> key >> value)
+        {
+            if (key == "rchar:")
+                c.rchar = value;
+            else if (key == "wchar:")
+                c.wchar = value;
+            else if (key == "read_bytes:")
+                c.read_bytes = value;
+            else if (key == "write_bytes:")
+                c.write_bytes = value;
+        }
+
+        return c;
+    }
+
+    process_counters operator-(const process_counters& other) const
+    {
+        process_counters c;
+
+        c.wall = wall - other.wall;
+        c.user = user - other.user;
+        c.system = system - other.system;
+        c.minor_faults = minor_faults - other.minor_faults;
+        c.major_faults = major_faults - other.major_faults;
+        c.rchar = rchar - other.rchar;
+        c.wchar = wchar - other.wchar;
+        c.read_bytes = read_bytes - other.read_bytes;
+        c.write_bytes = write_bytes - other.write_bytes;
+
+        return c;
+    }
+
+    process_counters operator+(const process_counters& other) const
+    {
+        process_counters c;
+
+        c.wall = wall + other.wall;
+        c.user = user + other.user;
+        c.system = system + other.system;
+        c.minor_faults = minor_faults + other.minor_faults;
+        c.major_faults = major_faults + other.major_faults;
+        c.rchar = rchar + other.rchar;
+        c.wchar = wchar + other.wchar;
+        c.read_bytes = read_bytes + other.read_bytes;
+        c.write_bytes = write_bytes + other.write_bytes;
+
+        return c;
+    }
+};
+
+// Record the time and resources used by each phase of a program and
+// write them as JSON. The counters are only sampled at the boundaries of
+// the phases, a few system calls each, so the profile can stay enabled
+// in production. A disabled profile does nothing.
+
+class phase_profile
+{
+private:
+
+    struct phase
+    {
+        std::string name;
+        process_counters counters;
+        uint64_t traces;
+        uint64_t bytes;
+    };
+
+    std::string program;
+    bool enabled;
+    std::vector<phase> phases;
+    std::string current;
+    process_counters first;
+    process_counters start;
+
+    static void write_string(std::ostream& out, const std::string& s)
+    {
+        out << '"';
+
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            char c = s[i];
+
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << ' ';
+            else
+                out << c;
+        }
+
+        out << '"';
+    }
+
+    static void write_phase(
+        std::ostream& out,
+        const std::string& name,
+        const process_counters& c,
+        uint64_t traces,
+        uint64_t bytes
+    )
+    {
+        out << "{\"name\": ";
+        write_string(out, name);
+        out << ", \"wall_s\": " << c.wall
+            << ", \"user_s\": " << c.user
+            << ", \"system_s\": " << c.system
+            << ", \"traces\": " << traces
+            << ", \"traces_per_s\": "
+            << (c.wall > 0 ? traces / c.wall : 0)
+            << ", \"bytes\": " << bytes
+            << ", \"minor_faults\": " << c.minor_faults
+            << ", \"major_faults\": " << c.major_faults
+            << ", \"rchar\": " << c.rchar
+            << ", \"wchar\": " << c.wchar
+            << ", \"read_bytes\": " << c.read_bytes
+            << ", \"write_bytes\": " << c.write_bytes
+            << "}";
+    }
+
+public:
+
+    phase_profile(const std::string& program, bool enabled) :
+        program(program),
+        enabled(enabled)
+    {
+        if (enabled)
+            first = process_counters::sample();
+    }
+
+    bool is_enabled() const
+    {
+        return enabled;
+    }
+
+    // Start a phase, ending the current one without any traces.
+
+    void begin(const std::string& name)
+    {
+        if (!enabled)
+            return;
+
+        if (current.size() != 0)
+            end();
+
+        current = name;
+        start = process_counters::sample();
+    }
+
+    // End the current phase, giving the number of traces and bytes it
+    // processed.
+
+    void end(uint64_t traces=0, uint64_t bytes=0)
+    {
+        if (!enabled || current.size() == 0)
+            return;
+
+        phase p;
+        p.name = current;
+        p.counters = process_counters::sample() - start;
+        p.traces = traces;
+        p.bytes = bytes;
+
+        phases.push_back(p);
+        current.clear();
+    }
+
+    // Write the phases and the totals of the whole program, including the
+    // time outside of any phase.
+
+    void write_json(std::ostream& out, uint64_t traces) const
+    {
+        process_counters total = process_counters::sample() - first;
+
+        uint64_t bytes = 0;
+
+        for (size_t i = 0; i < phases.size(); i++)
+            bytes += phases[i].bytes;
+
+        std::ios_base::fmtflags flags = out.flags();
+
+        out << std::fixed << std::setprecision(6);
+
+        out << "{\"program\": ";
+        write_string(out, program);
+        out << ", \"phases\": [";
+
+        for (size_t i = 0; i < phases.size(); i++)
+        {
+            out << (i != 0 ? ", " : "");
+            write_phase(out, phases[i].name, phases[i].counters,
+                phases[i].traces, phases[i].bytes);
+        }
+
+        out << "], \"total\": ";
+        write_phase(out, "total", total, traces, bytes);
+        out << "}" << std::endl;
+
+        out.flags(flags);
+    }
+
+    // Write the profile to a file, if enabled.
+
+    void write_json(const std::string& filename, uint64_t traces) const
+    {
+        if (!enabled)
+            return;
+
+        std::ofstream out(filename.c_str());
+
+        if (!out.is_open())
+            throw std::runtime_error("Failed to open " + filename + "!");
+
+        write_json(out, traces);
+
+        if (!out)
+            throw std::runtime_error("Failed to write " + filename + "!");
+    }
+};
+
+}}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "phase_profile.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Statistics of a query, split between the traversal of the index and
+// the copy of the selected traces. The candidates are the traces
+// returned by the index and the matches the traces written, which
+// differ when the headers are tested after the search (polygon,
+// corridor and offaz queries) or when the nearest traces of several
+// parts are merged. The pages are counted from the addresses of the
+// data in the mapping of the data file, before any of it is read.
+
+class query_explain
+{
+private:
+
+    typedef std::pair<uintptr_t, uintptr_t> page_range;
+
+    uintptr_t page_size;
+    std::vector<page_range> page_ranges;
+
+    misc::process_counters start;
+
+public:
+
+    size_t parts;
+    size_t candidates;
+    size_t matches;
+    uint64_t bytes;
+    misc::process_counters traversal;
+    misc::process_counters copy;
+
+    query_explain() :
+        page_size(0)
+    {
+        long size = sysconf(_SC_PAGESIZE);
+
+        page_size = size > 0 ? static_cast<uintptr_t>(size) : 4096;
+
+        clear();
+    }
+
+    void clear()
+    {
+        page_ranges.clear();
+
+        parts = 0;
+        candidates = 0;
+        matches = 0;
+        bytes = 0;
+        traversal = misc::process_counters();
+        copy = misc::process_counters();
+    }
+
+    void begin_traversal()
+    {
+        start = misc::process_counters::sample();
+    }
+
+    // End the traversal of the index of a part, giving the number of
+    // traces it returned.
+
+    void end_traversal(size_t part_candidates)
+    {
+        misc::process_counters c = misc::process_counters::sample() -
+            start;
+
+        traversal = traversal + c;
+
+        parts++;
+        candidates += part_candidates;
+    }
+
+    // Start copying the traces of an element range, recording their data
+    // before it is touched.
+
+    template <typename IT, typename MA>
+    void begin_copy(IT begin, IT end, const MA& meta_adapter)
+    {
+        for (; begin != end; begin++)
+        {
+            size_t size = meta_adapter.get_data_size(*begin->first);
+            uintptr_t data = reinterpret_cast<uintptr_t>(begin->second);
+
+            matches++;
+            bytes += size;
+
+            if (size != 0)
+            {
+                page_ranges.push_back(page_range(data / page_size,
+                    (data + size - 1) / page_size));
+            }
+        }
+
+        start = misc::process_counters::sample();
+    }
+
+    void end_copy()
+    {
+        copy = copy + (misc::process_counters::sample() - start);
+    }
+
+    // Count the distinct pages touched by the data of the matches.
+
+    uint64_t get_pages() const
+    {
+        std::vector<page_range> ranges(page_ranges);
+
+        std::sort(ranges.begin(), ranges.end());
+
+        uint64_t pages = 0;
+        uintptr_t next = 0;
+
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            uintptr_t first = std::max(ranges[i].first, next);
+
+            if (ranges[i].second >= first)
+            {
+                pages += ranges[i].second - first + 1;
+                next = ranges[i].second + 1;
+            }
+        }
+
+        return pages;
+    }
+
+    void print(std::ostream& out) const
+    {
+        std::ios_base::fmtflags flags = out.flags();
+
+        out << std::fixed << std::setprecision(6);
+
+        out << "Explain:" << std::endl
+            << "  parts searched:  " << parts << std::endl
+            << "  candidates:      " << candidates << std::endl
+            << "  matches:         " << matches << std::endl
+            << "  data bytes:      " << bytes << std::endl
+            << "  data pages:      " << get_pages() << std::endl
+            << "  traversal:       " << traversal.wall << " s, "
+            << traversal.major_faults << " major faults" << std::endl
+            << "  copy:            " << copy.wall << " s, "
+            << copy.major_faults << " major faults, "
+            << copy.read_bytes << " bytes read from disk" << std::endl;
+
+        out.flags(flags);
+    }
+};
+
+}}
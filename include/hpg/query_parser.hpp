@@ -38,6 +38,9 @@ enum query_type
     QUERY_TYPE_RANGE,
     QUERY_TYPE_NEAREST,
     QUERY_TYPE_EXACT,
+    QUERY_TYPE_POLYGON,
+    QUERY_TYPE_CORRIDOR,
+    QUERY_TYPE_OFFAZ,
 };
 
 class query_element
@@ -89,13 +92,19 @@ public:
         std::string range_token;
         std::string nearest_token;
         std::string exact_token;
+        std::string polygon_token;
+        std::string corridor_token;
+        std::string offaz_token;
 
         configuration() :
             field_sep_tokens(","),
             range_sep_tokens(":"),
             range_token("range"),
             nearest_token("nearest"),
-            exact_token("at")
+            exact_token("at"),
+            polygon_token("polygon"),
+            corridor_token("corridor"),
+            offaz_token("offaz")
         {
         }
     };
@@ -134,10 +143,60 @@ private:
         }
     }
 
+    // Vertices of polygons and corridors are given as x:y pairs of
+    // midpoint coordinates.
+
+    void parse_vertices(const tokens_t& tokens, size_t first, size_t last)
+    {
+        using namespace boost::algorithm;
+
+        for (size_t i = first; i < last; i++)
+        {
+            tokens_t values;
+            split(values, tokens[i], is_any_of(_config.range_sep_tokens),
+            token_compress_off);
+
+            if (values.size() != 2)
+            {
+                throw std::runtime_error(
+                    "Expected vertex as two values!");
+            }
+
+            _elements.push_back(query_element(values));
+        }
+    }
+
+    void parse_polygon_query(const tokens_t& tokens)
+    {
+        _query_type = QUERY_TYPE_POLYGON;
+        parse_vertices(tokens, 1, tokens.size());
+    }
+
+    void parse_corridor_query(const tokens_t& tokens)
+    {
+        _query_type = QUERY_TYPE_CORRIDOR;
+        parse_vertices(tokens, 1, tokens.size() - 1);
+
+        tokens_t values;
+        values.push_back(tokens.back());
+
+        _elements.push_back(query_element(values));
+    }
+
     void parse_range_query(const tokens_t& tokens)
     {
         _query_type = QUERY_TYPE_RANGE;
+        parse_range_elements(tokens);
+    }
+
+    void parse_offaz_query(const tokens_t& tokens)
+    {
+        _query_type = QUERY_TYPE_OFFAZ;
+        parse_range_elements(tokens);
+    }
 
+    void parse_range_elements(const tokens_t& tokens)
+    {
         using namespace boost::algorithm;
 
         for (size_t i = 1; i < tokens.size(); i++)
@@ -201,6 +260,38 @@ public:
 
             parse_exact_query(tokens);
         }
+        else if (tokens[0].compare(_config.polygon_token) == 0)
+        {
+            if (tokens.size() < 4)
+            {
+                throw std::runtime_error(
+                    "Invalid number of tokens for polygon query!");
+            }
+
+            parse_polygon_query(tokens);
+        }
+        else if (tokens[0].compare(_config.corridor_token) == 0)
+        {
+            if (tokens.size() < 4)
+            {
+                throw std::runtime_error(
+                    "Invalid number of tokens for corridor query!");
+            }
+
+            parse_corridor_query(tokens);
+        }
+        else if (tokens[0].compare(_config.offaz_token) == 0)
+        {
+            // Midpoint, half-offset and azimuth ranges.
+
+            if (tokens.size() != 5)
+            {
+                throw std::runtime_error(
+                    "Invalid number of tokens for offaz query!");
+            }
+
+            parse_offaz_query(tokens);
+        }
         else
         {
             throw std::runtime_error("Unknown query" +
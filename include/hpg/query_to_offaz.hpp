@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header_helper_mhaz.hpp"
+#include "query_to_shape.hpp"
+#include "custom_limits.hpp"
+#include "query_parser.hpp"
+
+#include <boost/geometry/core/coordinate_type.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <vector>
+#include <cmath>
+
+namespace s1o_example {
+namespace query {
+
+// An offaz query selects the traces inside midpoint ranges with the
+// half-offset length and azimuth inside the given ranges, which is an
+// annular sector in the half-offset plane. The azimuth is in degrees,
+// clockwise from north, and the sector wraps around when the first
+// azimuth is larger than the second (e.g. 330:30).
+
+class offaz_selector
+{
+private:
+
+    double _mmin[2];
+    double _mmax[2];
+    double _hmin;
+    double _hmax;
+    double _azmin;
+    double _azmax;
+    bool _full_circle;
+
+    static void get_values(
+        const query_element& elem,
+        double lowest,
+        double highest,
+        double& first,
+        double& second
+    )
+    {
+        if (elem.num_values() != 2)
+        {
+            throw std::runtime_error(
+                "Expected coordinate range as two values!");
+        }
+
+        first = elem.is_value_empty(0) ? lowest :
+            elem.get_value_as<double>(0);
+
+        second = elem.is_value_empty(1) ? highest :
+            elem.get_value_as<double>(1);
+    }
+
+    static double normalize_azimuth(double az)
+    {
+        az = std::fmod(az, 360.0);
+
+        return az < 0 ? az + 360.0 : az;
+    }
+
+    bool in_sector(double az) const
+    {
+        if (_full_circle)
+            return true;
+
+        if (_azmin <= _azmax)
+            return az >= _azmin && az <= _azmax;
+
+        return az >= _azmin || az <= _azmax;
+    }
+
+    // Extend a box in the half-offset plane by a point of the sector.
+
+    static void extend(double r, double az, double* lo, double* hi)
+    {
+        double theta = az * (M_PI / 180.0);
+        double hx = r * std::sin(theta);
+        double hy = r * std::cos(theta);
+
+        lo[0] = std::min(lo[0], hx);
+        lo[1] = std::min(lo[1], hy);
+        hi[0] = std::max(hi[0], hx);
+        hi[1] = std::max(hi[1], hy);
+    }
+
+public:
+
+    offaz_selector(const query_parser& query)
+    {
+        if (query.get_query_type() != QUERY_TYPE_OFFAZ)
+            throw std::runtime_error("Not an offaz query!");
+
+        const double inf = std::numeric_limits<double>::infinity();
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            double first, second;
+
+            get_values(query.get_query_element(i), -inf, inf, first,
+                second);
+
+            _mmin[i] = std::min(first, second);
+            _mmax[i] = std::max(first, second);
+        }
+
+        get_values(query.get_query_element(2), 0, inf, _hmin, _hmax);
+
+        if (_hmin < 0 || _hmax < _hmin)
+            throw std::runtime_error("Invalid half-offset range!");
+
+        double az0, az1;
+
+        get_values(query.get_query_element(3), 0, 360, az0, az1);
+
+        _full_circle = (query.get_query_element(3).is_value_empty(0) &&
+            query.get_query_element(3).is_value_empty(1)) ||
+            std::fabs(az1 - az0) >= 360;
+
+        _azmin = normalize_azimuth(az0);
+        _azmax = normalize_azimuth(az1);
+    }
+
+    // Get a conservative range of dataset points (mx, my, hx, hy)
+    // containing all selected traces, using the bounding box of the
+    // annular sector for the half-offsets.
+
+    template <typename P>
+    void get_range(P& p1, P& p2) const
+    {
+        typedef typename boost::geometry::traits::
+            coordinate_type<P>::type value_type;
+
+        typedef misc::custom_limits<value_type> nl;
+
+        const double lowest = nl::lowest();
+        const double highest = nl::highest();
+
+        p1.template set<0>(std::max(_mmin[0], lowest));
+        p1.template set<1>(std::max(_mmin[1], lowest));
+        p2.template set<0>(std::min(_mmax[0], highest));
+        p2.template set<1>(std::min(_mmax[1], highest));
+
+        double lo[2] = {0, 0};
+        double hi[2] = {0, 0};
+
+        if (_hmax > highest)
+        {
+            lo[0] = lo[1] = lowest;
+            hi[0] = hi[1] = highest;
+        }
+        else
+        {
+            // The box of an annular sector is given by its corners and
+            // by the points of the outer arc crossing the axes.
+
+            lo[0] = lo[1] = highest;
+            hi[0] = hi[1] = lowest;
+
+            if (!_full_circle)
+            {
+                extend(_hmin, _azmin, lo, hi);
+                extend(_hmin, _azmax, lo, hi);
+                extend(_hmax, _azmin, lo, hi);
+                extend(_hmax, _azmax, lo, hi);
+            }
+
+            for (int k = 0; k < 4; k++)
+            {
+                if (in_sector(90.0 * k))
+                    extend(_hmax, 90.0 * k, lo, hi);
+            }
+
+            // Account for the rounding of the trigonometric functions
+            // and of the conversion to the coordinate type.
+
+            double pad = 1e-6 * (_hmax + 1);
+
+            lo[0] -= pad;
+            lo[1] -= pad;
+            hi[0] += pad;
+            hi[1] += pad;
+        }
+
+        p1.template set<2>(lo[0]);
+        p1.template set<3>(lo[1]);
+        p2.template set<2>(hi[0]);
+        p2.template set<3>(hi[1]);
+    }
+
+    // Get the midpoint box, the half-offset lengths and the azimuth
+    // sectors of the selection, splitting a sector that wraps around
+    // north in two.
+
+    void get_midpoint_boxes(std::vector<midpoint_box_type>& boxes) const
+    {
+        boxes.assign(1, midpoint_box_type(
+            midpoint_type(_mmin[0], _mmin[1]),
+            midpoint_type(_mmax[0], _mmax[1])));
+    }
+
+    void get_half_offset_range(double& hmin, double& hmax) const
+    {
+        hmin = _hmin;
+        hmax = _hmax;
+    }
+
+    void get_azimuth_sectors(
+        std::vector<std::pair<double, double> >& sectors
+    ) const
+    {
+        sectors.clear();
+
+        if (_full_circle)
+        {
+            sectors.push_back(std::make_pair(0.0, 360.0));
+        }
+        else if (_azmin <= _azmax)
+        {
+            sectors.push_back(std::make_pair(_azmin, _azmax));
+        }
+        else
+        {
+            sectors.push_back(std::make_pair(_azmin, 360.0));
+            sectors.push_back(std::make_pair(0.0, _azmax));
+        }
+    }
+
+    // Get the ranges of dataset points containing all selected traces,
+    // a single one given by get_range.
+
+    template <typename P>
+    void get_ranges(std::vector<std::pair<P, P> >& ranges) const
+    {
+        ranges.resize(1);
+        get_range(ranges[0].first, ranges[0].second);
+    }
+
+    template <typename P>
+    bool operator()(const P& location) const
+    {
+        double mx = location.template get<0>();
+        double my = location.template get<1>();
+
+        if (mx < _mmin[0] || mx > _mmax[0] || my < _mmin[1] || my > _mmax[1])
+            return false;
+
+        double hx = location.template get<2>();
+        double hy = location.template get<3>();
+        double h = std::sqrt(hx * hx + hy * hy);
+
+        if (h < _hmin || h > _hmax)
+            return false;
+
+        return in_sector(io::half_offset_azimuth(hx, hy));
+    }
+};
+
+}}
@@ -83,6 +83,48 @@ struct query_to_range_impl<T, 0>
     }
 };
 
+template <typename T, unsigned int I>
+struct open_range_impl
+{
+    static const unsigned int J = I-1;
+
+    typedef typename boost::geometry::traits::
+        coordinate_type<T>::type value_type;
+
+    typedef open_range_impl<T, I-1> Next;
+
+    static void call(T& out_min, T& out_max)
+    {
+        typedef misc::custom_limits<value_type> nl;
+
+        out_min.template set<J>(nl::lowest());
+        out_max.template set<J>(nl::highest());
+
+        Next::call(out_min, out_max);
+    }
+};
+
+template <typename T>
+struct open_range_impl<T, 0>
+{
+    static void call(T& out_min, T& out_max)
+    {
+        (void)out_min;
+        (void)out_max;
+    }
+};
+
+}
+
+// Get a range containing every point.
+
+template <typename T>
+void open_range(T& out_min, T& out_max)
+{
+    detail::open_range_impl<
+        T,
+        boost::geometry::traits::dimension<T>::value
+        >::call(out_min, out_max);
 }
 
 template <typename T>
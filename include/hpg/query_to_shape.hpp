@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "custom_limits.hpp"
+#include "query_parser.hpp"
+
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/geometries/linestring.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/strategies/strategies.hpp>
+#include <boost/geometry/algorithms/append.hpp>
+#include <boost/geometry/algorithms/correct.hpp>
+#include <boost/geometry/algorithms/envelope.hpp>
+#include <boost/geometry/algorithms/covered_by.hpp>
+#include <boost/geometry/algorithms/intersects.hpp>
+#include <boost/geometry/algorithms/comparable_distance.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <vector>
+#include <cmath>
+
+namespace s1o_example {
+namespace query {
+
+// Shapes selecting traces by their midpoint coordinates (mx, my).
+
+typedef boost::geometry::model::d2::point_xy<double> midpoint_type;
+typedef boost::geometry::model::polygon<midpoint_type> polygon_type;
+typedef boost::geometry::model::linestring<midpoint_type> linestring_type;
+typedef boost::geometry::model::box<midpoint_type> midpoint_box_type;
+
+namespace detail {
+
+inline midpoint_type query_to_vertex(const query_element& elem)
+{
+    if (elem.num_values() != 2)
+        throw std::runtime_error("Expected vertex as two values!");
+
+    if (elem.is_value_empty(0) || elem.is_value_empty(1))
+        throw std::runtime_error("Vertex value is empty!");
+
+    return midpoint_type(elem.get_value_as<double>(0),
+        elem.get_value_as<double>(1));
+}
+
+// Range over a midpoint box and all half-offsets of a dataset point.
+
+template <typename P>
+void midpoint_box_to_range(const midpoint_box_type& box, P& p1, P& p2)
+{
+    typedef typename boost::geometry::traits::
+        coordinate_type<P>::type value_type;
+
+    typedef misc::custom_limits<value_type> nl;
+
+    p1.template set<0>(box.min_corner().x());
+    p1.template set<1>(box.min_corner().y());
+    p1.template set<2>(nl::lowest());
+    p1.template set<3>(nl::lowest());
+
+    p2.template set<0>(box.max_corner().x());
+    p2.template set<1>(box.max_corner().y());
+    p2.template set<2>(nl::highest());
+    p2.template set<3>(nl::highest());
+}
+
+// Ranges over midpoint boxes and all half-offsets of a dataset point.
+
+template <typename P>
+void midpoint_boxes_to_ranges(
+    const std::vector<midpoint_box_type>& boxes,
+    std::vector<std::pair<P, P> >& ranges
+)
+{
+    ranges.resize(boxes.size());
+
+    for (size_t i = 0; i < boxes.size(); i++)
+        midpoint_box_to_range(boxes[i], ranges[i].first, ranges[i].second);
+}
+
+// Box around the segment from a to b expanded by width.
+
+inline midpoint_box_type get_segment_box(
+    const midpoint_type& a,
+    const midpoint_type& b,
+    double width
+)
+{
+    return midpoint_box_type(
+        midpoint_type(std::min(a.x(), b.x()) - width,
+            std::min(a.y(), b.y()) - width),
+        midpoint_type(std::max(a.x(), b.x()) + width,
+            std::max(a.y(), b.y()) + width));
+}
+
+// Maximum number of boxes searched for a shape, besides one per edge.
+const size_t max_shape_boxes = 256;
+
+// Number of rows and columns of the grid covering a polygon.
+const size_t polygon_grid_size = 16;
+
+template <typename P>
+midpoint_type get_midpoint(const P& location)
+{
+    return midpoint_type(location.template get<0>(),
+        location.template get<1>());
+}
+
+}
+
+// A polygon query selects the traces with midpoints inside or on the
+// border of the polygon. The polygon is closed and oriented
+// automatically.
+
+class polygon_selector
+{
+private:
+
+    polygon_type _polygon;
+    midpoint_box_type _envelope;
+
+public:
+
+    polygon_selector(const query_parser& query)
+    {
+        if (query.get_query_type() != QUERY_TYPE_POLYGON)
+            throw std::runtime_error("Not a polygon query!");
+
+        for (size_t i = 0; i < query.get_num_query_elements(); i++)
+        {
+            boost::geometry::append(_polygon,
+                detail::query_to_vertex(query.get_query_element(i)));
+        }
+
+        boost::geometry::correct(_polygon);
+        boost::geometry::envelope(_polygon, _envelope);
+    }
+
+    // Get midpoint boxes covering the polygon. The envelope is split in a
+    // grid and the runs of cells touching the polygon in each row become
+    // a box, so thin or diagonal polygons do not search their whole
+    // envelope.
+
+    void get_midpoint_boxes(std::vector<midpoint_box_type>& boxes) const
+    {
+        const size_t n = detail::polygon_grid_size;
+
+        double x0 = _envelope.min_corner().x();
+        double y0 = _envelope.min_corner().y();
+        double dx = (_envelope.max_corner().x() - x0) / n;
+        double dy = (_envelope.max_corner().y() - y0) / n;
+
+        boxes.clear();
+
+        for (size_t j = 0; j < n; j++)
+        {
+            double y1 = y0 + j * dy;
+            double y2 = j + 1 == n ? _envelope.max_corner().y() : y1 + dy;
+
+            size_t run = n;
+
+            for (size_t i = 0; i <= n; i++)
+            {
+                double x1 = x0 + i * dx;
+                double x2 = i + 1 == n ? _envelope.max_corner().x() :
+                    x1 + dx;
+
+                bool touches = i < n && boost::geometry::intersects(
+                    midpoint_box_type(midpoint_type(x1, y1),
+                        midpoint_type(x2, y2)), _polygon);
+
+                if (touches && run == n)
+                    run = i;
+
+                if (!touches && run != n)
+                {
+                    boxes.push_back(midpoint_box_type(
+                        midpoint_type(x0 + run * dx, y1),
+                        midpoint_type(i == n ?
+                            _envelope.max_corner().x() : x1, y2)));
+
+                    run = n;
+                }
+            }
+        }
+
+        // Degenerate polygons may not touch any cell.
+
+        if (boxes.size() == 0)
+            boxes.push_back(_envelope);
+    }
+
+    // Get ranges of dataset points containing all selected traces.
+
+    template <typename P>
+    void get_ranges(std::vector<std::pair<P, P> >& ranges) const
+    {
+        std::vector<midpoint_box_type> boxes;
+
+        get_midpoint_boxes(boxes);
+        detail::midpoint_boxes_to_ranges(boxes, ranges);
+    }
+
+    // The shapes select traces at any half-offset length and azimuth.
+
+    void get_half_offset_range(double& hmin, double& hmax) const
+    {
+        hmin = 0;
+        hmax = std::numeric_limits<double>::infinity();
+    }
+
+    void get_azimuth_sectors(
+        std::vector<std::pair<double, double> >& sectors
+    ) const
+    {
+        sectors.assign(1, std::make_pair(0.0, 360.0));
+    }
+
+    template <typename P>
+    bool operator()(const P& location) const
+    {
+        return boost::geometry::covered_by(detail::get_midpoint(location),
+            _polygon);
+    }
+};
+
+// A corridor query selects the traces with midpoints within a distance
+// of a polyline, such as the surface projection of a well path.
+
+class corridor_selector
+{
+private:
+
+    linestring_type _path;
+    double _width;
+    double _comparable_width;
+
+public:
+
+    corridor_selector(const query_parser& query)
+    {
+        if (query.get_query_type() != QUERY_TYPE_CORRIDOR)
+            throw std::runtime_error("Not a corridor query!");
+
+        size_t nvertices = query.get_num_query_elements() - 1;
+
+        for (size_t i = 0; i < nvertices; i++)
+        {
+            boost::geometry::append(_path,
+                detail::query_to_vertex(query.get_query_element(i)));
+        }
+
+        const query_element& elem_width = query.get_query_element(
+            nvertices);
+
+        if (elem_width.num_values() != 1 || elem_width.is_value_empty())
+            throw std::runtime_error("Expect width as a single value!");
+
+        _width = elem_width.get_value_as<double>();
+
+        if (_width < 0)
+            throw std::runtime_error("The corridor width is negative!");
+
+        // Compare squared distances, which avoids a square root per
+        // trace in the cartesian system.
+
+        _comparable_width = _width * _width;
+    }
+
+    double get_width() const
+    {
+        return _width;
+    }
+
+    // Get midpoint boxes covering the corridor, one per segment of the
+    // path expanded by the width instead of the envelope of the whole
+    // path. Long segments are split so each box stays close to the path.
+
+    void get_midpoint_boxes(std::vector<midpoint_box_type>& boxes) const
+    {
+        boxes.clear();
+
+        if (_path.size() == 1)
+        {
+            boxes.push_back(detail::get_segment_box(_path[0], _path[0],
+                _width));
+            return;
+        }
+
+        double length = 0;
+
+        for (size_t i = 1; i < _path.size(); i++)
+        {
+            length += std::sqrt(boost::geometry::comparable_distance(
+                _path[i - 1], _path[i]));
+        }
+
+        // Pieces shorter than a few widths only add boxes that overlap.
+
+        double piece = std::max(4 * _width,
+            length / detail::max_shape_boxes);
+
+        for (size_t i = 1; i < _path.size(); i++)
+        {
+            const midpoint_type& a = _path[i - 1];
+            const midpoint_type& b = _path[i];
+
+            double d = std::sqrt(boost::geometry::comparable_distance(a, b));
+            size_t m = piece > 0 ? static_cast<size_t>(std::ceil(d / piece)) :
+                1;
+
+            m = std::max<size_t>(m, 1);
+
+            for (size_t k = 0; k < m; k++)
+            {
+                double t0 = static_cast<double>(k) / m;
+                double t1 = static_cast<double>(k + 1) / m;
+
+                boxes.push_back(detail::get_segment_box(
+                    midpoint_type(a.x() + (b.x() - a.x()) * t0,
+                        a.y() + (b.y() - a.y()) * t0),
+                    midpoint_type(a.x() + (b.x() - a.x()) * t1,
+                        a.y() + (b.y() - a.y()) * t1),
+                    _width));
+            }
+        }
+    }
+
+    // Get ranges of dataset points containing all selected traces.
+
+    template <typename P>
+    void get_ranges(std::vector<std::pair<P, P> >& ranges) const
+    {
+        std::vector<midpoint_box_type> boxes;
+
+        get_midpoint_boxes(boxes);
+        detail::midpoint_boxes_to_ranges(boxes, ranges);
+    }
+
+    // The shapes select traces at any half-offset length and azimuth.
+
+    void get_half_offset_range(double& hmin, double& hmax) const
+    {
+        hmin = 0;
+        hmax = std::numeric_limits<double>::infinity();
+    }
+
+    void get_azimuth_sectors(
+        std::vector<std::pair<double, double> >& sectors
+    ) const
+    {
+        sectors.assign(1, std::make_pair(0.0, 360.0));
+    }
+
+    template <typename P>
+    bool operator()(const P& location) const
+    {
+        return boost::geometry::comparable_distance(
+            detail::get_midpoint(location), _path) <= _comparable_width;
+    }
+};
+
+}}
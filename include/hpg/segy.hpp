@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "su.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace s1o_example {
+namespace io {
+
+// Convert n IBM 4-byte floats, already in native byte order, to IEEE
+// floats. The IBM value is frac * 16^(exp-64) / 2^24,
+// which is computed exactly in double precision by building the power of
+// two directly from its bits, so the loop has no branches or calls and
+// can be vectorized by the compiler. The conversion may be done in place.
+
+inline void ibm_to_ieee(const void* ibm, sample_t* out, size_t n)
+{
+    const double fmax = std::numeric_limits<sample_t>::max();
+    const char* p = static_cast<const char*>(ibm);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t v;
+        std::memcpy(&v, p + i * sizeof(v), sizeof(v));
+
+        uint64_t exp = (v >> 24) & 0x7f;
+        uint32_t frac = v & 0x00ffffff;
+
+        // 2^(4*(exp-64)-24) with the double exponent bias of 1023.
+
+        uint64_t bits = (4 * exp + 743) << 52;
+
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+
+        double d = static_cast<double>(frac) * scale;
+
+        d = (v >> 31) != 0 ? -d : d;
+
+        // IBM floats have a larger range than IEEE single precision.
+
+        d = std::min(std::max(d, -fmax), fmax);
+
+        out[i] = static_cast<sample_t>(d);
+    }
+}
+
+// Check if a file should be read as SEG-Y from its extension.
+
+inline bool is_segy_filename(const std::string& filename)
+{
+    size_t dot = filename.rfind('.');
+
+    if (dot == std::string::npos)
+        return false;
+
+    std::string ext = filename.substr(dot + 1);
+
+    for (size_t i = 0; i < ext.size(); i++)
+        ext[i] = static_cast<char>(std::tolower(ext[i]));
+
+    return ext == "sgy" || ext == "segy";
+}
+
+// Read-only SEG-Y dataset with the same interface as su_dataset. The
+// textual and binary file headers are parsed when the file is opened and
+// the samples are converted to sample_t while being read.
+
+class segy_dataset
+{
+private:
+
+    enum
+    {
+        FORMAT_IBM_FLOAT = 1,
+        FORMAT_INT32 = 2,
+        FORMAT_INT16 = 3,
+        FORMAT_IEEE_FLOAT = 5,
+        FORMAT_INT8 = 8,
+    };
+
+    std::string filename;
+    std::fstream file;
+    std::string textual;
+    su_endian endian;
+    bool swap;
+    int format;
+    unsigned int sample_size;
+    unsigned int file_ns;
+    unsigned int file_dt;
+    std::vector<char> raw;
+
+    template <typename T>
+    T get(const char* p) const
+    {
+        char bytes[sizeof(T)];
+
+        std::memcpy(bytes, p, sizeof(T));
+
+        if (swap)
+            std::reverse(bytes, bytes + sizeof(T));
+
+        T val;
+        std::memcpy(&val, bytes, sizeof(T));
+
+        return val;
+    }
+
+    static unsigned int get_sample_size(int format)
+    {
+        switch (format)
+        {
+        case FORMAT_IBM_FLOAT:
+        case FORMAT_INT32:
+        case FORMAT_IEEE_FLOAT:
+            return 4;
+        case FORMAT_INT16:
+            return 2;
+        case FORMAT_INT8:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    void read_file_headers()
+    {
+        char binary[binary_header_size];
+
+        textual.resize(textual_header_size);
+
+        if (!file.read(&textual[0], textual_header_size) ||
+            !file.read(binary, binary_header_size))
+        {
+            throw std::runtime_error(
+                std::string("Failed to read the file headers of ") +
+                filename + "!");
+        }
+
+        // SEG-Y files should be big-endian, but little-endian files are
+        // common, so use the byte order that yields a known format code.
+
+        endian = SU_ENDIAN_BIG;
+        swap = su_needs_swap(endian);
+        format = get<int16_t>(binary + 24);
+
+        if (get_sample_size(format) == 0)
+        {
+            endian = SU_ENDIAN_LITTLE;
+            swap = su_needs_swap(endian);
+            format = get<int16_t>(binary + 24);
+        }
+
+        sample_size = get_sample_size(format);
+
+        if (sample_size == 0)
+        {
+            throw std::runtime_error(
+                std::string("Unsupported sample format in ") +
+                filename + "!");
+        }
+
+        file_dt = get<uint16_t>(binary + 16);
+        file_ns = get<uint16_t>(binary + 20);
+
+        // Skip the extended textual headers.
+
+        int16_t next = get<int16_t>(binary + 304);
+
+        if (next < 0)
+        {
+            throw std::runtime_error(
+                std::string("Variable number of extended headers in ") +
+                filename + " is not supported!");
+        }
+
+        if (!file.seekg(static_cast<std::streamoff>(next) *
+            textual_header_size, std::ios_base::cur))
+        {
+            throw std::runtime_error(
+                std::string("Failed to seek file ") +
+                filename + "!");
+        }
+    }
+
+    bool read_raw_header(char* data, uint64_t& id)
+    {
+        // Use the position in the file as the id of the trace.
+        id = this->file.tellg();
+
+        return static_cast<bool>(this->file.read(data,
+            su_dataset::su_header_size));
+    }
+
+    // Decode trace headers, using the values from the binary header when
+    // a trace does not have its own.
+
+    void decode_headers(
+        const char* const* data,
+        const uint64_t* ids,
+        size_t n,
+        trace_header* headers
+    ) const
+    {
+        su_dataset::decode_headers(data, ids, n, headers, endian);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (headers[i].Ns == 0)
+                headers[i].Ns = file_ns;
+
+            if (headers[i].Dt == 0)
+                headers[i].Dt = static_cast<double>(file_dt) / 1.0e6;
+        }
+    }
+
+    bool read_header(trace_header& header)
+    {
+        char data[su_dataset::su_header_size];
+        const char* p = data;
+        uint64_t id;
+
+        if (!read_raw_header(data, id))
+            return false;
+
+        decode_headers(&p, &id, 1, &header);
+
+        return true;
+    }
+
+    void skip_samples(unsigned int ns)
+    {
+        if (!this->file.seekg(static_cast<std::streamoff>(sample_size) * ns,
+            std::ios_base::cur))
+        {
+            throw std::runtime_error(
+                std::string("Failed to seek file ") +
+                filename + "!");
+        }
+    }
+
+    void read_samples(unsigned int ns, sample_t* samples)
+    {
+        // Four-byte samples are read directly to the output and converted
+        // in place, smaller samples need a separate buffer.
+
+        char* buffer = reinterpret_cast<char*>(samples);
+
+        if (sample_size != sizeof(sample_t))
+        {
+            raw.resize(static_cast<size_t>(sample_size) * ns);
+            buffer = raw.empty() ? 0 : &raw[0];
+        }
+
+        if (!this->file.read(buffer, static_cast<std::streamsize>(
+            sample_size) * ns))
+        {
+            throw std::runtime_error(
+                std::string("Failed to read samples from ") +
+                filename + "!");
+        }
+
+        if (sample_size == sizeof(sample_t) && swap)
+            su_swap_samples(samples, ns);
+
+        switch (format)
+        {
+        case FORMAT_IBM_FLOAT:
+            ibm_to_ieee(samples, samples, ns);
+            break;
+        case FORMAT_INT32:
+            for (unsigned int i = 0; i < ns; i++)
+            {
+                int32_t v;
+                std::memcpy(&v, samples + i, sizeof(v));
+                samples[i] = static_cast<sample_t>(v);
+            }
+            break;
+        case FORMAT_INT16:
+            for (unsigned int i = 0; i < ns; i++)
+                samples[i] = static_cast<sample_t>(get<int16_t>(buffer + 2 * i));
+            break;
+        case FORMAT_INT8:
+            for (unsigned int i = 0; i < ns; i++)
+                samples[i] = static_cast<sample_t>(static_cast<int8_t>(buffer[i]));
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+
+    static const unsigned int textual_header_size = 3200;
+    static const unsigned int binary_header_size = 400;
+
+    // The byte order of SEG-Y files is detected from the binary header,
+    // the endian argument only exists to match su_dataset.
+
+    segy_dataset(
+        const std::string& filename,
+        su_endian endian=SU_ENDIAN_NATIVE
+    ) :
+        filename(filename), file(), textual(), endian(endian), swap(false),
+        format(0), sample_size(0), file_ns(0), file_dt(0), raw()
+    {
+        this->file.open(filename.c_str(), std::fstream::in |
+                std::fstream::binary);
+
+        if (!this->file.is_open()) {
+            throw std::runtime_error("Failed to open " + filename + "!");
+        }
+
+        read_file_headers();
+    }
+
+    ~segy_dataset()
+    {
+        file.close();
+    }
+
+    // The textual file header, usually encoded in EBCDIC.
+
+    const std::string& get_textual_header() const
+    {
+        return textual;
+    }
+
+    bool read_trace_header(trace_header& header)
+    {
+        if (!read_header(header))
+            return false;
+
+        skip_samples(header.Ns);
+
+        return true;
+    }
+
+    size_t read_trace_headers(trace_header* headers, size_t n)
+    {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+        {
+            if (!read_trace_header(headers[i]))
+                break;
+        }
+
+        return i;
+    }
+
+    bool read_trace(trace_header& header, std::vector<sample_t>& samples)
+    {
+        if (!read_header(header))
+            return false;
+
+        samples.resize(header.Ns);
+
+        read_samples(header.Ns, samples.empty() ? 0 : &samples[0]);
+
+        return true;
+    }
+
+    // Read and convert the samples directly to a buffer supplied by the
+    // caller. The buffer must have room for at least max_ns samples.
+
+    bool read_trace(
+        trace_header& header,
+        sample_t* samples,
+        unsigned int max_ns
+    )
+    {
+        if (!read_header(header))
+            return false;
+
+        if (header.Ns > max_ns)
+        {
+            throw std::runtime_error(
+                std::string("Trace larger than the buffer in ") +
+                filename + "!");
+        }
+
+        read_samples(header.Ns, samples);
+
+        return true;
+    }
+};
+
+}}
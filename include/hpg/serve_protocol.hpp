@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Protocol between s1o_serve and s1o_client over a Unix domain socket.
+// The client sends a single request line with the tab-separated dataset
+// name, number of slots, slot, query and order of the traces ("file" or
+// "spatial"). The server answers with a status line, either "OK" or
+// "ERROR" followed by a tab and the message, and in case of success
+// streams the SU traces followed by a trailer. The trailer is a status
+// line padded with zeros to serve_trailer_size bytes, either "END" with
+// the number of traces and bytes streamed or "ERROR" with the message of
+// the failure that interrupted the stream. Its size is fixed so the
+// client can tell it apart from the traces by holding back the last
+// bytes it received, and a stream without it was truncated.
+
+struct serve_request
+{
+    std::string dataset;
+    size_t slots;
+    size_t slot;
+    std::string query;
+    bool file_order;
+};
+
+// Maximum length of a request line.
+const size_t serve_max_line = 64 * 1024;
+
+// Size of the trailer that ends the stream of traces.
+const size_t serve_trailer_size = 256;
+
+inline void serve_send_all(int fd, const std::string& data)
+{
+    const char* p = data.c_str();
+    size_t remaining = data.size();
+
+    while (remaining != 0)
+    {
+        ssize_t n = send(fd, p, remaining, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw std::runtime_error("Failed to write to the socket!");
+        }
+
+        p += n;
+        remaining -= static_cast<size_t>(n);
+    }
+}
+
+// Read a line without its terminator. The line is read one byte at a
+// time, so nothing after it is consumed from the socket.
+
+inline bool serve_recv_line(int fd, std::string& line)
+{
+    line.clear();
+
+    for (;;)
+    {
+        char c;
+        ssize_t n = read(fd, &c, 1);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                throw std::runtime_error("Timed out reading the socket!");
+
+            throw std::runtime_error("Failed to read from the socket!");
+        }
+
+        if (n == 0)
+            return line.size() != 0;
+
+        if (c == '\n')
+            return true;
+
+        if (line.size() == serve_max_line)
+            throw std::runtime_error("Line too long!");
+
+        line += c;
+    }
+}
+
+// Pad a status line to a trailer, cutting messages that do not fit.
+
+inline std::string format_trailer(const std::string& status)
+{
+    std::string trailer(status, 0, serve_trailer_size - 1);
+
+    std::replace(trailer.begin(), trailer.end(), '\n', ' ');
+
+    trailer += '\n';
+    trailer.resize(serve_trailer_size, '\0');
+
+    return trailer;
+}
+
+// Get the status line of a trailer, which is empty when the bytes are
+// not a trailer.
+
+inline std::string parse_trailer(const char* trailer)
+{
+    const char* end = static_cast<const char*>(std::memchr(trailer, '\n',
+        serve_trailer_size));
+
+    if (end == 0)
+        return std::string();
+
+    for (const char* p = end + 1; p != trailer + serve_trailer_size; p++)
+    {
+        if (*p != '\0')
+            return std::string();
+    }
+
+    return std::string(trailer, end);
+}
+
+inline std::string format_request(const serve_request& request)
+{
+    if (request.dataset.find_first_of("\t\n") != std::string::npos ||
+        request.query.find_first_of("\t\n") != std::string::npos)
+    {
+        throw std::runtime_error("Invalid character in the request!");
+    }
+
+    return request.dataset + "\t" +
+        boost::lexical_cast<std::string>(request.slots) + "\t" +
+        boost::lexical_cast<std::string>(request.slot) + "\t" +
+        request.query + "\t" +
+        (request.file_order ? "file" : "spatial") + "\n";
+}
+
+inline serve_request parse_request(const std::string& line)
+{
+    using namespace boost::algorithm;
+
+    std::vector<std::string> fields;
+    split(fields, line, is_any_of("\t"), token_compress_off);
+
+    if (fields.size() != 5 || (fields[4] != "file" &&
+        fields[4] != "spatial"))
+        throw std::runtime_error("Malformed request!");
+
+    serve_request request;
+
+    request.dataset = fields[0];
+    request.slots = boost::lexical_cast<size_t>(fields[1]);
+    request.slot = boost::lexical_cast<size_t>(fields[2]);
+    request.query = fields[3];
+    request.file_order = fields[4] == "file";
+
+    return request;
+}
+
+inline struct sockaddr_un get_socket_address(const std::string& path)
+{
+    struct sockaddr_un addr;
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path " + path + " is too long!");
+
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    return addr;
+}
+
+// Create the listening socket of the server, replacing any stale socket
+// file left at the path.
+
+inline int listen_socket(const std::string& path)
+{
+    struct sockaddr_un addr = get_socket_address(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        throw std::runtime_error("Failed to create socket!");
+
+    unlink(path.c_str());
+
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+        sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to listen on " + path + "!");
+    }
+
+    return fd;
+}
+
+inline int connect_socket(const std::string& path)
+{
+    struct sockaddr_un addr = get_socket_address(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        throw std::runtime_error("Failed to create socket!");
+
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+        sizeof(addr)) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to connect to " + path + "!");
+    }
+
+    return fd;
+}
+
+// Make blocking reads and writes on a socket fail after the given number
+// of seconds without progress, so an idle peer cannot hold its end of the
+// connection forever. A write only fails when no buffer space was freed
+// for the whole period, so a slow reader still consuming the stream is
+// never disconnected. Zero disables the timeouts.
+
+inline void set_socket_timeout(int fd, unsigned int seconds)
+{
+    struct timeval tv;
+
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+    {
+        throw std::runtime_error("Failed to set the socket timeout!");
+    }
+}
+
+}}
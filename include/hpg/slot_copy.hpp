@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "dataset_5d.hpp"
+#include "su_mmap.hpp"
+#include "segy.hpp"
+#include "su.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <iostream>
+#include <string>
+
+namespace s1o_example {
+namespace io {
+
+// Ensure two trace headers are equal.
+
+inline void assert_same_header(
+    const trace_header& a,
+    const trace_header& b
+)
+{
+    if (a.CDP != b.CDP)
+    {
+        throw std::runtime_error(
+            std::string("The field CDP of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.CDP) + " vs " +
+            boost::lexical_cast<std::string>(b.CDP) + "!");
+    }
+
+    if (a.Offset != b.Offset)
+    {
+        throw std::runtime_error(
+            std::string("The field Offset of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.Offset) + " vs " +
+            boost::lexical_cast<std::string>(b.Offset) + "!");
+    }
+
+    if (a.SrcX != b.SrcX)
+    {
+        throw std::runtime_error(
+            std::string("The field SrcX of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.SrcX) + " vs " +
+            boost::lexical_cast<std::string>(b.SrcX) + "!");
+    }
+
+    if (a.SrcY != b.SrcY)
+    {
+        throw std::runtime_error(
+            std::string("The field SrcY of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.SrcY) + " vs " +
+            boost::lexical_cast<std::string>(b.SrcY) + "!");
+    }
+
+    if (a.RcvX != b.RcvX)
+    {
+        throw std::runtime_error(
+            std::string("The field RcvX of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.RcvX) + " vs " +
+            boost::lexical_cast<std::string>(b.RcvX) + "!");
+    }
+
+    if (a.RcvY != b.RcvY)
+    {
+        throw std::runtime_error(
+            std::string("The field RcvY of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.RcvY) + " vs " +
+            boost::lexical_cast<std::string>(b.RcvY) + "!");
+    }
+
+    if (a.Delrt != b.Delrt)
+    {
+        throw std::runtime_error(
+            std::string("The field Delrt of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.Delrt) + " vs " +
+            boost::lexical_cast<std::string>(b.Delrt) + "!");
+    }
+
+    if (a.Ns != b.Ns)
+    {
+        throw std::runtime_error(
+            std::string("The field Ns of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.Ns) + " vs " +
+            boost::lexical_cast<std::string>(b.Ns) + "!");
+    }
+
+    if (a.Dt != b.Dt)
+    {
+        throw std::runtime_error(
+            std::string("The field Dt of the trace ") +
+            boost::lexical_cast<std::string>(a.Id) + " at byte " +
+            boost::lexical_cast<std::string>(b.Id) + " differ: " +
+            boost::lexical_cast<std::string>(a.Dt) + " vs " +
+            boost::lexical_cast<std::string>(b.Dt) + "!");
+    }
+}
+
+// Copy the next ntraces traces of an SU file to a slot in the dataset,
+// reading the samples directly to their location in the dataset.
+// Returns the number of traces copied, which is smaller than ntraces
+// only if the SU file ended first.
+
+template <typename R, typename D>
+size_t copy_traces_to_slot(
+    R& inds,
+    D& outds,
+    size_t slot,
+    size_t ntraces,
+    size_t ndelta
+)
+{
+    s1o::uid_t uid;
+    trace_header inheader;
+    trace_header* p_outheader;
+    char* p_outdata;
+
+    for (uid = 1; uid <= ntraces; uid++)
+    {
+        outds.get_element(uid, slot, p_outheader, p_outdata);
+
+        // The size of the trace is limited by the reference header.
+
+        sample_t* outsamples = reinterpret_cast<sample_t*>(p_outdata);
+
+        if (!inds.read_trace(inheader, outsamples, p_outheader->Ns))
+            break;
+
+        if (ndelta != 0 && (uid % ndelta) == 0)
+        {
+            std::cerr
+                << ".";
+        }
+
+        // Headers must match.
+
+        assert_same_header(inheader, *p_outheader);
+    }
+
+    return uid-1;
+}
+
+// Check the headers of the next ntraces traces of an SU file against the
+// dataset without reading their samples. Returns the number of traces
+// checked, which is smaller than ntraces only if the SU file ended first.
+
+template <typename R, typename D>
+size_t check_traces_in_slot(
+    R& inds,
+    D& outds,
+    size_t slot,
+    size_t ntraces
+)
+{
+    s1o::uid_t uid;
+    trace_header inheader;
+    trace_header* p_outheader;
+    char* p_outdata;
+
+    for (uid = 1; uid <= ntraces; uid++)
+    {
+        if (!inds.read_trace_header(inheader))
+            break;
+
+        outds.get_element(uid, slot, p_outheader, p_outdata);
+
+        assert_same_header(inheader, *p_outheader);
+    }
+
+    return uid-1;
+}
+
+// Ensure an SU file has no traces left after being copied, otherwise
+// throw an error with the total number of traces in the file.
+
+template <typename R>
+void assert_no_more_traces(
+    R& inds,
+    const std::string& infile,
+    size_t ncopied,
+    size_t ntraces
+)
+{
+    trace_header inheader;
+
+    size_t n = ncopied;
+
+    while (inds.read_trace_header(inheader))
+        n++;
+
+    // The number of traces must match.
+
+    if (n != ntraces)
+    {
+        throw std::runtime_error(
+            std::string("The number of traces in file ") +
+            infile + " differ from dataset: " +
+            boost::lexical_cast<std::string>(n) + " vs " +
+            boost::lexical_cast<std::string>(ntraces) + "!");
+    }
+}
+
+// Copy the next traces of an SU file to a slot of each part of a dataset
+// chain in order, such as the datasets of a dataset_chain, filling every
+// part before the next. Returns the number of traces copied, which is
+// smaller than the size of the chain only if the SU file ended first.
+
+template <typename R, typename C>
+size_t copy_traces_to_parts(
+    R& inds,
+    C& parts,
+    size_t slot,
+    size_t ndelta
+)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        size_t ntraces = parts[i].get_max_elements();
+        size_t ncopied = copy_traces_to_slot(inds, parts[i], slot, ntraces,
+            ndelta);
+
+        n += ncopied;
+
+        if (ncopied != ntraces)
+            break;
+    }
+
+    return n;
+}
+
+// Copy the samples of a single SU or SEG-Y file to its slot in all parts
+// of a dataset chain.
+
+template <typename R, typename C>
+size_t copy_slot(
+    C& parts,
+    size_t slot,
+    const std::string& infile,
+    size_t ndelta,
+    su_endian endian
+)
+{
+    if (ndelta != 0)
+    {
+        std::cerr
+            << infile;
+    }
+
+    size_t ntraces = 0;
+
+    for (size_t i = 0; i < parts.size(); i++)
+        ntraces += parts[i].get_max_elements();
+
+    R inds(infile, endian);
+
+    size_t n = copy_traces_to_parts(inds, parts, slot, ndelta);
+
+    if (ndelta != 0)
+    {
+        std::cerr
+            << std::endl;
+    }
+
+    assert_no_more_traces(inds, infile, n, ntraces);
+
+    return n;
+}
+
+template <typename C>
+size_t copy_slot(
+    C& parts,
+    size_t slot,
+    const std::string& infile,
+    size_t ndelta,
+    su_endian endian=SU_ENDIAN_NATIVE
+)
+{
+    if (is_segy_filename(infile))
+    {
+        return copy_slot<segy_dataset>(parts, slot, infile, ndelta,
+            endian);
+    }
+
+    return copy_slot<su_input_dataset>(parts, slot, infile, ndelta,
+        endian);
+}
+
+}}
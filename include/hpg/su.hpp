@@ -25,25 +25,83 @@
 #include <algorithm>
 #include <stdexcept>
 #include <fstream>
+#include <cstring>
 #include <limits>
 #include <vector>
+#include <cmath>
 
 #include <stdint.h>
 
 namespace s1o_example {
 namespace io {
 
+// Byte order of the binary data in an SU file.
+
+enum su_endian
+{
+    SU_ENDIAN_NATIVE,
+    SU_ENDIAN_LITTLE,
+    SU_ENDIAN_BIG,
+};
+
+// Check if data in the given byte order must be swapped to be used in
+// this machine.
+
+inline bool su_needs_swap(su_endian endian)
+{
+    const uint16_t one = 1;
+    const bool native_big = reinterpret_cast<const char*>(&one)[0] == 0;
+
+    switch (endian)
+    {
+    case SU_ENDIAN_LITTLE:
+        return native_big;
+    case SU_ENDIAN_BIG:
+        return !native_big;
+    default:
+        return false;
+    }
+}
+
+// Reverse the bytes of each sample in place.
+
+inline void su_swap_samples(sample_t* samples, size_t ns)
+{
+    char* p = reinterpret_cast<char*>(samples);
+
+    for (size_t i = 0; i < ns; i++, p += sizeof(sample_t))
+        std::reverse(p, p + sizeof(sample_t));
+}
+
 class su_dataset
 {
 private:
 
     std::string filename;
     std::fstream file;
+    su_endian endian;
+    bool swap;
+    std::vector<char> scan_block;
+    uint64_t scan_block_pos;
+    size_t scan_block_size;
+
+    // Get a value that may be stored in a different byte order. The
+    // value is copied to avoid unaligned accesses.
 
     template <typename T>
-    static T get(const char* p)
+    static T get(const char* p, bool swap)
     {
-        return reinterpret_cast<const T*>(p)[0];
+        char bytes[sizeof(T)];
+
+        std::memcpy(bytes, p, sizeof(T));
+
+        if (swap)
+            std::reverse(bytes, bytes + sizeof(T));
+
+        T val;
+        std::memcpy(&val, bytes, sizeof(T));
+
+        return val;
     }
 
     template <typename T>
@@ -56,7 +114,12 @@ private:
     {
         samples.resize(ns);
 
-        char* buffer = reinterpret_cast<char*>(&samples[0]);
+        read_samples(ns, &samples[0]);
+    }
+
+    void read_samples(unsigned int ns, sample_t* samples)
+    {
+        char* buffer = reinterpret_cast<char*>(samples);
 
         if (!this->file.read(buffer, sizeof(sample_t) * ns))
         {
@@ -64,6 +127,9 @@ private:
                 std::string("Failed to read samples from ") +
                 filename + "!");
         }
+
+        if (swap)
+            su_swap_samples(samples, ns);
     }
 
     void skip_samples(unsigned int ns)
@@ -76,54 +142,44 @@ private:
         }
     }
 
-    bool read_header(trace_header& header)
+    bool read_raw_header(char* data, uint64_t& id)
     {
-        char data[su_header_size];
-
         // Use the position in the file as the id of the trace.
-        uint64_t id = this->file.tellg();
-
-        if (!this->file.read(data, su_header_size))
-            return false;
+        id = this->file.tellg();
 
-        // Process the data in the header.
+        return static_cast<bool>(this->file.read(data, su_header_size));
+    }
 
-        int cdp = get<int>(data + 20);
+    // Read the block of the file starting at pos to scan_block. Returns
+    // false if it does not hold at least a whole header.
 
-        double offset = static_cast<double>(get<int>(data + 36));
+    bool read_scan_block(uint64_t pos)
+    {
+        if (scan_block.size() == 0)
+            scan_block.resize(su_scan_block_size);
 
-        double scaling = static_cast<double>(get<short>(data + 70));
+        this->file.clear();
 
-        if (scaling < 0)
-            scaling = -1.0 / scaling;
+        if (!this->file.seekg(pos))
+            return false;
 
-        double srcx = static_cast<double>(get<int>(data + 72)) * scaling;
-        double srcy = static_cast<double>(get<int>(data + 76)) * scaling;
-        double rcvx = static_cast<double>(get<int>(data + 80)) * scaling;
-        double rcvy = static_cast<double>(get<int>(data + 84)) * scaling;
+        this->file.read(&scan_block[0], scan_block.size());
 
-        double delrt = static_cast<double>(get<unsigned short>(data + 108)) / 1.0e3;
-        double dt = static_cast<double>(get<unsigned short>(data + 116)) / 1.0e6;
+        scan_block_pos = pos;
+        scan_block_size = static_cast<size_t>(this->file.gcount());
 
-        unsigned int ns = get<unsigned short>(data + 114);
+        return scan_block_size >= su_header_size;
+    }
 
-        // Use the factory created by f1d to ensure no field is left unset.
+    bool read_header(trace_header& header)
+    {
+        char data[su_header_size];
+        uint64_t id;
 
-        trace_header_factory thf;
-        thf.begin();
-        thf.set_Id(id);
-        thf.set_CDP(cdp);
-        thf.set_Offset(offset);
-        thf.set_SrcX(srcx);
-        thf.set_SrcY(srcy);
-        thf.set_RcvX(rcvx);
-        thf.set_RcvY(rcvy);
-        thf.set_Delrt(delrt);
-        thf.set_Ns(ns);
-        thf.set_Dt(dt);
-        thf.end();
+        if (!read_raw_header(data, id))
+            return false;
 
-        header = thf.get();
+        decode_header(data, id, header, endian);
 
         return true;
     }
@@ -132,8 +188,19 @@ public:
 
     static const unsigned int su_header_size = 240;
 
-    su_dataset(const std::string& filename) :
-        filename(filename), file()
+    // Maximum number of headers decoded together by decode_headers.
+    static const size_t su_decode_block = 64;
+
+    // Size of the blocks read by read_trace_headers.
+    static const size_t su_scan_block_size = 1 << 20;
+
+    su_dataset(
+        const std::string& filename,
+        su_endian endian=SU_ENDIAN_NATIVE
+    ) :
+        filename(filename), file(), endian(endian),
+        swap(su_needs_swap(endian)), scan_block(), scan_block_pos(0),
+        scan_block_size(0)
     {
         this->file.open(filename.c_str(), std::fstream::in |
                 std::fstream::binary);
@@ -158,6 +225,70 @@ public:
         return true;
     }
 
+    // Read the headers of up to n traces, skipping their samples, and
+    // decode them together. Returns the number of headers read, which is
+    // smaller than n only at the end of the file. The file is read in
+    // large blocks and the headers are picked from them, so the scan
+    // costs one read per block instead of a read and a seek per trace.
+
+    size_t read_trace_headers(trace_header* headers, size_t n)
+    {
+        const char* raw[su_decode_block];
+        uint64_t ids[su_decode_block];
+
+        if (!this->file)
+            return 0;
+
+        uint64_t pos = this->file.tellg();
+        size_t nread = 0;
+        size_t m = 0;
+
+        scan_block_size = 0;
+
+        while (nread + m < n)
+        {
+            // Decode the pending headers before their block is replaced.
+
+            if (pos < scan_block_pos ||
+                pos + su_header_size > scan_block_pos + scan_block_size)
+            {
+                decode_headers(raw, ids, m, headers + nread, endian);
+
+                nread += m;
+                m = 0;
+
+                if (!read_scan_block(pos))
+                    break;
+            }
+
+            raw[m] = &scan_block[pos - scan_block_pos];
+            ids[m] = pos;
+
+            pos += su_header_size + sizeof(sample_t) *
+                get<unsigned short>(raw[m] + 114, swap);
+
+            if (++m == su_decode_block)
+            {
+                decode_headers(raw, ids, m, headers + nread, endian);
+
+                nread += m;
+                m = 0;
+            }
+        }
+
+        decode_headers(raw, ids, m, headers + nread, endian);
+
+        nread += m;
+
+        // Leave the file at the next trace, as a sequence of calls to
+        // read_trace_header would.
+
+        this->file.clear();
+        this->file.seekg(pos);
+
+        return nread;
+    }
+
     bool read_trace(trace_header& header, std::vector<sample_t>& samples)
     {
         if (!read_header(header))
@@ -168,34 +299,162 @@ public:
         return true;
     }
 
-    static void write_header(const trace_header& header, std::ostream& stream)
+    // Read the samples directly to a buffer supplied by the caller,
+    // avoiding an intermediate copy. The buffer must have room for at
+    // least max_ns samples.
+
+    bool read_trace(
+        trace_header& header,
+        sample_t* samples,
+        unsigned int max_ns
+    )
     {
-        char data[su_header_size];
+        if (!read_header(header))
+            return false;
 
-        std::fill(data, data + su_header_size, 0);
+        if (header.Ns > max_ns)
+        {
+            throw std::runtime_error(
+                std::string("Trace larger than the buffer in ") +
+                filename + "!");
+        }
 
-        // Convert the data in the header back to binary.
+        read_samples(header.Ns, samples);
 
-        set<int>(data + 20, header.CDP);
+        return true;
+    }
 
-        set<int>(data + 36, static_cast<int>(header.Offset));
+    // Convert the raw SU header in data to the trace_header format,
+    // using id as the id of the trace.
 
-        short scalco = 1;
+    static void decode_header(
+        const char* data,
+        uint64_t id,
+        trace_header& header,
+        su_endian endian=SU_ENDIAN_NATIVE
+    )
+    {
+        decode_headers(&data, &id, 1, &header, endian);
+    }
+
+    // Convert n raw SU headers to the trace_header format. The fields of
+    // each block of headers are first gathered into separate arrays so
+    // the byte swapping and the conversions run as simple loops over
+    // contiguous data that the compiler can vectorize.
+
+    static void decode_headers(
+        const char* const* data,
+        const uint64_t* ids,
+        size_t n,
+        trace_header* headers,
+        su_endian endian=SU_ENDIAN_NATIVE
+    )
+    {
+        const bool swap = su_needs_swap(endian);
+
+        int32_t cdp[su_decode_block];
+        int32_t offset[su_decode_block];
+        int16_t scalco[su_decode_block];
+        int32_t coords[4][su_decode_block];
+        uint16_t delrt[su_decode_block];
+        uint16_t ns[su_decode_block];
+        uint16_t dt[su_decode_block];
 
-        while (true)
+        double scaling[su_decode_block];
+        double scaled[4][su_decode_block];
+
+        // Copy the block size, since std::min would need its definition.
+        const size_t block = su_decode_block;
+
+        for (size_t b = 0; b < n; b += block)
         {
-            double maxp = std::max(std::max(std::max(header.SrcX,
-                header.SrcY), header.RcvX), header.RcvY);
+            size_t m = std::min(n - b, block);
+
+            // Gather the fields used by trace_header.
+
+            for (size_t i = 0; i < m; i++)
+            {
+                const char* p = data[b + i];
+
+                cdp[i] = get<int32_t>(p + 20, swap);
+                offset[i] = get<int32_t>(p + 36, swap);
+                scalco[i] = get<int16_t>(p + 70, swap);
+                coords[0][i] = get<int32_t>(p + 72, swap);
+                coords[1][i] = get<int32_t>(p + 76, swap);
+                coords[2][i] = get<int32_t>(p + 80, swap);
+                coords[3][i] = get<int32_t>(p + 84, swap);
+                delrt[i] = get<uint16_t>(p + 108, swap);
+                ns[i] = get<uint16_t>(p + 114, swap);
+                dt[i] = get<uint16_t>(p + 116, swap);
+            }
+
+            // Apply the coordinate scaling.
+
+            for (size_t i = 0; i < m; i++)
+            {
+                // A zero scalco means the coordinates are not scaled.
+
+                double s = static_cast<double>(scalco[i]);
+                scaling[i] = s < 0 ? -1.0 / s : s > 0 ? s : 1.0;
+            }
+
+            for (size_t c = 0; c < 4; c++)
+            {
+                for (size_t i = 0; i < m; i++)
+                {
+                    scaled[c][i] = static_cast<double>(coords[c][i]) *
+                        scaling[i];
+                }
+            }
+
+            // Use the factory created by f1d to ensure no field is left
+            // unset.
+
+            for (size_t i = 0; i < m; i++)
+            {
+                trace_header_factory thf;
+                thf.begin();
+                thf.set_Id(ids[b + i]);
+                thf.set_CDP(cdp[i]);
+                thf.set_Offset(static_cast<double>(offset[i]));
+                thf.set_SrcX(scaled[0][i]);
+                thf.set_SrcY(scaled[1][i]);
+                thf.set_RcvX(scaled[2][i]);
+                thf.set_RcvY(scaled[3][i]);
+                thf.set_Delrt(static_cast<double>(delrt[i]) / 1.0e3);
+                thf.set_Ns(ns[i]);
+                thf.set_Dt(static_cast<double>(dt[i]) / 1.0e6);
+                thf.end();
+
+                headers[b + i] = thf.get();
+            }
+        }
+    }
 
-            const double limp = static_cast<double>(
-                std::numeric_limits<int>::max());
+    static void write_header(const trace_header& header, std::ostream& stream)
+    {
+        char data[su_header_size];
 
-            if (maxp < limp)
-                break;
+        encode_header(header, data);
 
-            int iscalco = scalco * 10;
+        stream.write(data, su_header_size);
+    }
+
+    // Get the smallest coordinate scaling (a power of 10) that allows
+    // coordinates up to maxabs in absolute value to be stored.
 
-            const int lims = std::numeric_limits<short>::max();
+    static short get_scalco(double maxabs)
+    {
+        const double limp = static_cast<double>(
+            std::numeric_limits<int>::max());
+
+        const int lims = std::numeric_limits<short>::max();
+
+        short scalco = 1;
+
+        while (maxabs / scalco >= limp)
+        {
+            int iscalco = scalco * 10;
 
             if (iscalco > lims)
                 throw std::runtime_error("Coordinate scaling error!");
@@ -203,6 +462,43 @@ public:
             scalco = static_cast<short>(iscalco);
         }
 
+        return scalco;
+    }
+
+    // Get the largest absolute coordinate of a trace.
+
+    static double get_max_abs_coord(const trace_header& header)
+    {
+        return std::max(std::max(std::fabs(header.SrcX),
+            std::fabs(header.SrcY)), std::max(std::fabs(header.RcvX),
+            std::fabs(header.RcvY)));
+    }
+
+    // Convert a trace_header to a raw SU header stored in data, which
+    // must have room for su_header_size bytes.
+
+    static void encode_header(const trace_header& header, char* data)
+    {
+        encode_header(header, data, get_scalco(get_max_abs_coord(header)));
+    }
+
+    // Convert a trace_header to a raw SU header using a coordinate
+    // scaling shared by many traces, see get_scalco.
+
+    static void encode_header(
+        const trace_header& header,
+        char* data,
+        short scalco
+    )
+    {
+        std::fill(data, data + su_header_size, 0);
+
+        // Convert the data in the header back to binary.
+
+        set<int>(data + 20, header.CDP);
+
+        set<int>(data + 36, static_cast<int>(header.Offset));
+
         int srcx = static_cast<int>(header.SrcX / scalco);
         int srcy = static_cast<int>(header.SrcY / scalco);
         int rcvx = static_cast<int>(header.RcvX / scalco);
@@ -219,8 +515,20 @@ public:
         set<unsigned short>(data + 116, static_cast<unsigned short>(header.Dt * 1.0e6));
 
         set<unsigned short>(data + 114, static_cast<unsigned short>(header.Ns));
+    }
 
-        stream.write(data, su_header_size);
+    // Convert n trace_headers to consecutive raw SU headers using the
+    // same coordinate scaling.
+
+    static void encode_headers(
+        const trace_header* headers,
+        size_t n,
+        char* data,
+        short scalco
+    )
+    {
+        for (size_t i = 0; i < n; i++)
+            encode_header(headers[i], data + i * su_header_size, scalco);
     }
 };
 
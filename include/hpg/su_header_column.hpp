@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "su.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Raw SU headers of all traces of a dataset, encoded once when the
+// dataset is packed and stored next to it ordered by the uid of the
+// traces. Extractors can copy the 240-byte images directly instead of
+// encoding the headers again for every trace. All headers share a single
+// coordinate scaling computed from the entire dataset.
+
+class su_header_column
+{
+private:
+
+    std::string filename;
+    const char* base;
+    size_t num_headers;
+
+    // The mapping is owned by a single object.
+    su_header_column(const su_header_column&);
+    su_header_column& operator=(const su_header_column&);
+
+public:
+
+    static std::string get_filename(const std::string& dataset)
+    {
+        return dataset + ".suh";
+    }
+
+    // Encode the headers in [begin, end), which must be ordered by uid
+    // starting in 1, and store them as the column of a dataset.
+
+    template <typename IT>
+    static void write(const std::string& dataset, IT begin, IT end)
+    {
+        std::string filename = get_filename(dataset);
+
+        // Find a single scaling for the entire dataset.
+
+        double maxabs = 0;
+        uint64_t uid = 1;
+
+        for (IT it = begin; it != end; it++, uid++)
+        {
+            if (it->Id != uid)
+            {
+                throw std::runtime_error(
+                    "Headers must be ordered by uid to build the "
+                    "header column!");
+            }
+
+            maxabs = std::max(maxabs, su_dataset::get_max_abs_coord(*it));
+        }
+
+        short scalco = su_dataset::get_scalco(maxabs);
+
+        // Encode the headers in batches.
+
+        std::ofstream file(filename.c_str(), std::ios_base::binary |
+            std::ios_base::trunc);
+
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open " + filename + "!");
+
+        const size_t batch = 4096;
+
+        std::vector<trace_header> headers;
+        std::vector<char> data(batch * su_dataset::su_header_size);
+
+        headers.reserve(batch);
+
+        IT it = begin;
+
+        while (it != end)
+        {
+            headers.clear();
+
+            for (; it != end && headers.size() < batch; it++)
+                headers.push_back(*it);
+
+            su_dataset::encode_headers(&headers[0], headers.size(),
+                &data[0], scalco);
+
+            file.write(&data[0], headers.size() *
+                su_dataset::su_header_size);
+        }
+
+        if (!file)
+            throw std::runtime_error("Failed to write " + filename + "!");
+    }
+
+    // Open the column of a dataset with num_headers traces. If the file
+    // does not exist or does not match the dataset, the column is not
+    // available and the headers must be encoded when extracted.
+
+    su_header_column(const std::string& dataset, size_t num_headers) :
+        filename(get_filename(dataset)),
+        base(0),
+        num_headers(num_headers)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            return;
+
+        struct stat st;
+
+        uint64_t size = static_cast<uint64_t>(num_headers) *
+            su_dataset::su_header_size;
+
+        if (fstat(fd, &st) == 0 && size != 0 &&
+            static_cast<uint64_t>(st.st_size) == size)
+        {
+            void* p = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (p != MAP_FAILED)
+                base = static_cast<const char*>(p);
+        }
+
+        close(fd);
+    }
+
+    ~su_header_column()
+    {
+        if (base != 0)
+        {
+            munmap(const_cast<char*>(base), num_headers *
+                su_dataset::su_header_size);
+        }
+    }
+
+    bool is_available() const
+    {
+        return base != 0;
+    }
+
+    // Get the raw SU header of the trace with the given uid.
+
+    const char* get(uint64_t uid) const
+    {
+        if (base == 0 || uid == 0 || uid > num_headers)
+            throw std::runtime_error("Header column index out of range!");
+
+        return base + (uid - 1) * su_dataset::su_header_size;
+    }
+};
+
+}}
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "su.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Read-only SU dataset backed by a memory mapping of the entire file.
+// Headers and samples are accessed directly from the mapping instead of
+// being copied through stream buffers.
+
+class su_dataset_mmap
+{
+private:
+
+    std::string filename;
+    const char* base;
+    uint64_t size;
+    uint64_t pos;
+    su_endian endian;
+    bool swap;
+
+    // The mapping is owned by a single object.
+    su_dataset_mmap(const su_dataset_mmap&);
+    su_dataset_mmap& operator=(const su_dataset_mmap&);
+
+    // Get the raw header of the trace at the current position and
+    // advance to the next trace, without decoding the header.
+
+    bool next_raw_trace(const char*& raw_header, uint64_t& id)
+    {
+        const uint64_t header_size = su_dataset::su_header_size;
+
+        if (pos + header_size > size)
+            return false;
+
+        raw_header = base + pos;
+
+        // Use the position in the file as the id of the trace.
+
+        id = pos;
+
+        // Only the number of samples is needed to find the next trace.
+
+        char ns_bytes[2] = { raw_header[114], raw_header[115] };
+
+        if (swap)
+            std::swap(ns_bytes[0], ns_bytes[1]);
+
+        uint16_t ns;
+        std::memcpy(&ns, ns_bytes, sizeof(ns));
+
+        uint64_t data_size = sizeof(sample_t) * static_cast<uint64_t>(ns);
+
+        if (pos + header_size + data_size > size)
+        {
+            throw std::runtime_error(
+                std::string("Truncated trace in file ") +
+                filename + "!");
+        }
+
+        pos += header_size + data_size;
+
+        return true;
+    }
+
+    // Get the raw header and samples of the trace at the current
+    // position and advance to the next trace.
+
+    bool next_trace(
+        trace_header& header,
+        const char*& raw_header,
+        const sample_t*& samples
+    )
+    {
+        uint64_t id;
+
+        if (!next_raw_trace(raw_header, id))
+            return false;
+
+        su_dataset::decode_header(raw_header, id, header, endian);
+
+        samples = reinterpret_cast<const sample_t*>(raw_header +
+            su_dataset::su_header_size);
+
+        return true;
+    }
+
+public:
+
+    su_dataset_mmap(
+        const std::string& filename,
+        su_endian endian=SU_ENDIAN_NATIVE
+    ) :
+        filename(filename), base(0), size(0), pos(0), endian(endian),
+        swap(su_needs_swap(endian))
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + filename + "!");
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to stat " + filename + "!");
+        }
+
+        size = static_cast<uint64_t>(st.st_size);
+
+        // An empty file cannot be mapped, but it is a valid file with
+        // no traces.
+
+        if (size != 0)
+        {
+            void* p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Failed to map " + filename + "!");
+            }
+
+            base = static_cast<const char*>(p);
+
+            // The file is always traversed from start to end.
+
+            madvise(p, size, MADV_SEQUENTIAL);
+        }
+
+        // The mapping remains valid after the descriptor is closed.
+
+        close(fd);
+    }
+
+    ~su_dataset_mmap()
+    {
+        if (base != 0)
+            munmap(const_cast<char*>(base), size);
+    }
+
+    bool read_trace_header(trace_header& header)
+    {
+        const char* raw_header;
+        const sample_t* samples;
+
+        return next_trace(header, raw_header, samples);
+    }
+
+    // Read the headers of up to n traces and decode them together.
+    // Returns the number of headers read, which is smaller than n only
+    // at the end of the file.
+
+    size_t read_trace_headers(trace_header* headers, size_t n)
+    {
+        const char* raw[su_dataset::su_decode_block];
+        uint64_t ids[su_dataset::su_decode_block];
+
+        const size_t block = su_dataset::su_decode_block;
+        size_t nread = 0;
+
+        while (nread < n)
+        {
+            size_t m = std::min(n - nread, block);
+            size_t i;
+
+            for (i = 0; i < m; i++)
+            {
+                if (!next_raw_trace(raw[i], ids[i]))
+                    break;
+            }
+
+            su_dataset::decode_headers(raw, ids, i, headers + nread,
+                endian);
+
+            nread += i;
+
+            if (i != m)
+                break;
+        }
+
+        return nread;
+    }
+
+    bool read_trace(trace_header& header, std::vector<sample_t>& samples)
+    {
+        const char* raw_header;
+        const sample_t* p_samples;
+
+        if (!next_trace(header, raw_header, p_samples))
+            return false;
+
+        samples.assign(p_samples, p_samples + header.Ns);
+
+        if (swap && header.Ns != 0)
+            su_swap_samples(&samples[0], header.Ns);
+
+        return true;
+    }
+
+    // Read the samples directly to a buffer supplied by the caller. The
+    // buffer must have room for at least max_ns samples.
+
+    bool read_trace(
+        trace_header& header,
+        sample_t* samples,
+        unsigned int max_ns
+    )
+    {
+        const char* raw_header;
+        const sample_t* p_samples;
+
+        if (!next_trace(header, raw_header, p_samples))
+            return false;
+
+        if (header.Ns > max_ns)
+        {
+            throw std::runtime_error(
+                std::string("Trace larger than the buffer in ") +
+                filename + "!");
+        }
+
+        std::copy(p_samples, p_samples + header.Ns, samples);
+
+        if (swap)
+            su_swap_samples(samples, header.Ns);
+
+        return true;
+    }
+
+    // Read the next trace without copying, the pointers remain valid
+    // for the lifetime of the object. The samples are in the byte order
+    // of the file, so this is only allowed for native byte order.
+
+    bool read_trace(
+        trace_header& header,
+        const sample_t*& samples,
+        const char** raw_header=0
+    )
+    {
+        if (swap)
+        {
+            throw std::runtime_error(
+                std::string("Zero-copy reads require native byte order in ") +
+                filename + "!");
+        }
+
+        const char* p_header;
+
+        if (!next_trace(header, p_header, samples))
+            return false;
+
+        if (raw_header != 0)
+            *raw_header = p_header;
+
+        return true;
+    }
+};
+
+// The SU reader used by the tools, selected at build time.
+
+#if defined(S1O_EXAMPLE_SU_MMAP)
+typedef su_dataset_mmap su_input_dataset;
+#else
+typedef su_dataset su_input_dataset;
+#endif
+
+}}
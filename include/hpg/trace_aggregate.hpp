@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "header_fields.hpp"
+#include "trace_query.hpp"
+#include "query_parser.hpp"
+#include "dataset_chain.hpp"
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <utility>
+#include <limits>
+#include <string>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace s1o_example {
+namespace io {
+
+enum aggregate_type
+{
+    AGGREGATE_COUNT,
+    AGGREGATE_BBOX,
+    AGGREGATE_FOLD,
+    AGGREGATE_HIST
+};
+
+// Summarize the traces selected by a query from their headers only:
+//
+//   count               the number of traces
+//   bbox                the minimum and maximum of every header field
+//   fold                the number of traces per CDP
+//   fold,dx,dy          the number of traces per midpoint bin
+//   hist,field[,width]  the histogram of a header field
+//
+// The aggregator replaces the trace_writer as the output of the query
+// routines and never reads the trace data.
+
+class trace_aggregator
+{
+private:
+
+    typedef std::pair<int64_t, int64_t> bin_type;
+    typedef std::map<bin_type, uint64_t> bin_map;
+
+    aggregate_type type;
+    const header_field* field;
+    double width_x;
+    double width_y;
+    uint64_t count;
+    std::vector<double> mins;
+    std::vector<double> maxs;
+    bin_map bins;
+
+    static int64_t get_bin(double value, double width)
+    {
+        return static_cast<int64_t>(std::floor(value / width));
+    }
+
+    static double parse_width(const std::string& s)
+    {
+        double width = boost::lexical_cast<double>(s);
+
+        if (!(width > 0))
+            throw std::runtime_error("The bin width must be positive!");
+
+        return width;
+    }
+
+public:
+
+    trace_aggregator(const std::string& spec) :
+        type(AGGREGATE_COUNT),
+        field(0),
+        width_x(1),
+        width_y(1)
+    {
+        using namespace boost::algorithm;
+
+        std::vector<std::string> args;
+        split(args, spec, is_any_of(","), token_compress_off);
+
+        if (args[0] == "count" && args.size() == 1)
+        {
+            type = AGGREGATE_COUNT;
+        }
+        else if (args[0] == "bbox" && args.size() == 1)
+        {
+            type = AGGREGATE_BBOX;
+        }
+        else if (args[0] == "fold" && (args.size() == 1 || args.size() == 3))
+        {
+            // Without bin sizes the traces are grouped by their CDP.
+
+            type = AGGREGATE_FOLD;
+
+            if (args.size() == 3)
+            {
+                width_x = parse_width(args[1]);
+                width_y = parse_width(args[2]);
+            }
+            else
+            {
+                width_x = 0;
+                width_y = 0;
+            }
+        }
+        else if (args[0] == "hist" && (args.size() == 2 || args.size() == 3))
+        {
+            type = AGGREGATE_HIST;
+            field = &find_header_field(args[1]);
+
+            if (args.size() == 3)
+                width_x = parse_width(args[2]);
+        }
+        else
+        {
+            throw std::runtime_error("Invalid aggregate " + spec + "!");
+        }
+
+        clear();
+    }
+
+    void clear()
+    {
+        count = 0;
+        mins.assign(num_header_fields, std::numeric_limits<double>::max());
+        maxs.assign(num_header_fields, -std::numeric_limits<double>::max());
+        bins.clear();
+    }
+
+    uint64_t get_count() const
+    {
+        return count;
+    }
+
+    void add(const trace_header& header)
+    {
+        count++;
+
+        switch (type)
+        {
+        case AGGREGATE_COUNT:
+            break;
+        case AGGREGATE_BBOX:
+            for (size_t i = 0; i < num_header_fields; i++)
+            {
+                double value = get_header_field(i).get(header);
+
+                mins[i] = std::min(mins[i], value);
+                maxs[i] = std::max(maxs[i], value);
+            }
+            break;
+        case AGGREGATE_FOLD:
+            if (width_x == 0)
+            {
+                bins[bin_type(header.CDP, 0)]++;
+            }
+            else
+            {
+                bins[bin_type(
+                    get_bin(detail_header_fields::get_mx(header), width_x),
+                    get_bin(detail_header_fields::get_my(header), width_y))
+                    ]++;
+            }
+            break;
+        case AGGREGATE_HIST:
+            bins[bin_type(get_bin(field->get(header), width_x), 0)]++;
+            break;
+        }
+    }
+
+    // Print the result as tab-separated lines with a header line.
+
+    void print(std::ostream& out) const
+    {
+        std::ios_base::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision(15);
+
+        switch (type)
+        {
+        case AGGREGATE_COUNT:
+            out << "traces" << std::endl
+                << count << std::endl;
+            break;
+        case AGGREGATE_BBOX:
+            out << "field\tmin\tmax" << std::endl;
+
+            for (size_t i = 0; count != 0 && i < num_header_fields; i++)
+            {
+                out << get_header_field(i).name << "\t" << mins[i] << "\t"
+                    << maxs[i] << std::endl;
+            }
+            break;
+        case AGGREGATE_FOLD:
+            if (width_x == 0)
+                out << "CDP\tfold" << std::endl;
+            else
+                out << "mx\tmy\tfold" << std::endl;
+
+            for (bin_map::const_iterator it = bins.begin();
+                it != bins.end(); it++)
+            {
+                if (width_x == 0)
+                {
+                    out << it->first.first;
+                }
+                else
+                {
+                    out << (it->first.first + 0.5) * width_x << "\t"
+                        << (it->first.second + 0.5) * width_y;
+                }
+
+                out << "\t" << it->second << std::endl;
+            }
+            break;
+        case AGGREGATE_HIST:
+            out << field->name << "_min\t" << field->name << "_max\ttraces"
+                << std::endl;
+
+            for (bin_map::const_iterator it = bins.begin();
+                it != bins.end(); it++)
+            {
+                out << it->first.first * width_x << "\t"
+                    << (it->first.first + 1) * width_x << "\t"
+                    << it->second << std::endl;
+            }
+            break;
+        }
+
+        out.precision(precision);
+        out.flags(flags);
+    }
+};
+
+// Add a selected trace to the aggregate, ignoring its data.
+
+template <typename MA>
+void copy_trace(
+    const trace_header& header,
+    const char* data,
+    const MA& meta_adapter,
+    const s1o_example::io::su_header_column* column,
+    trace_aggregator& aggregator
+)
+{
+    (void)data;
+    (void)meta_adapter;
+    (void)column;
+
+    aggregator.add(header);
+}
+
+// Aggregate the traces selected by a query.
+
+template <typename D>
+size_t aggregate_traces_query(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    trace_aggregator& aggregator,
+    std::ostream& log
+)
+{
+    return copy_traces_query(chain, slot,
+        std::numeric_limits<size_t>::max(), query,
+        get_header_only_options(options), aggregator, log);
+}
+
+}}
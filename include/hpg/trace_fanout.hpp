@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "trace_writer.hpp"
+#include "su.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+
+namespace s1o_example {
+namespace io {
+
+namespace detail {
+
+// A batch of traces shared by all outputs of a fanout. The header of
+// each trace is the same for all outputs, only the samples differ.
+
+struct fanout_batch
+{
+    std::vector<char> encoded;
+    size_t num_encoded;
+    std::vector<const char*> headers;
+    std::vector<size_t> sizes;
+    std::vector<const char*> data;
+};
+
+struct fanout_output
+{
+    int fd;
+    bool started;
+    pthread_t thread;
+    std::deque<boost::shared_ptr<const fanout_batch> > queue;
+    std::string error;
+};
+
+}
+
+// Write the same sequence of SU traces, with different samples, to
+// several file descriptors. Each header is encoded once for all outputs
+// and the batches are handed to one writer thread per output, so the
+// caller can traverse the dataset a single time while the outputs are
+// written concurrently.
+
+class trace_fanout
+{
+private:
+
+    // Number of traces in each batch handed to the writers.
+    static const size_t batch_traces = 512;
+
+    // Number of batches queued per output before the caller blocks.
+    static const size_t max_queued = 4;
+
+    struct worker_arg
+    {
+        trace_fanout* fanout;
+        size_t index;
+    };
+
+    std::vector<detail::fanout_output> outputs;
+    std::vector<worker_arg> args;
+    boost::shared_ptr<detail::fanout_batch> current;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool closed;
+    bool finished;
+
+    // The mutex and threads are owned by a single object.
+    trace_fanout(const trace_fanout&);
+    trace_fanout& operator=(const trace_fanout&);
+
+    static void* worker(void* p)
+    {
+        worker_arg& arg = *static_cast<worker_arg*>(p);
+
+        arg.fanout->run(arg.index);
+
+        return 0;
+    }
+
+    void run(size_t index)
+    {
+        detail::fanout_output& output = outputs[index];
+
+        trace_writer writer(output.fd);
+
+        for (;;)
+        {
+            boost::shared_ptr<const detail::fanout_batch> batch;
+
+            pthread_mutex_lock(&lock);
+
+            while (output.queue.empty() && !closed)
+                pthread_cond_wait(&cond, &lock);
+
+            if (!output.queue.empty())
+            {
+                batch = output.queue.front();
+                output.queue.pop_front();
+                pthread_cond_broadcast(&cond);
+            }
+
+            pthread_mutex_unlock(&lock);
+
+            if (!batch)
+                break;
+
+            // After an error the batches are still consumed, so the
+            // caller is never blocked by a failed output.
+
+            if (output.error.size() != 0)
+                continue;
+
+            // The writer references the batch, so it must be flushed
+            // before the batch is released.
+
+            try
+            {
+                size_t n = batch->sizes.size();
+                size_t nout = outputs.size();
+
+                for (size_t i = 0; i < n; i++)
+                {
+                    writer.write_trace_raw(batch->headers[i],
+                        batch->data[i * nout + index], batch->sizes[i]);
+                }
+
+                writer.flush();
+            }
+            catch (const std::exception& e)
+            {
+                output.error = e.what();
+            }
+            catch (...)
+            {
+                output.error = "Unknown error!";
+            }
+        }
+    }
+
+    void submit()
+    {
+        if (!current || current->sizes.size() == 0)
+            return;
+
+        boost::shared_ptr<const detail::fanout_batch> batch = current;
+
+        current.reset();
+
+        pthread_mutex_lock(&lock);
+
+        for (size_t i = 0; i < outputs.size(); i++)
+        {
+            while (outputs[i].queue.size() >= max_queued)
+                pthread_cond_wait(&cond, &lock);
+
+            outputs[i].queue.push_back(batch);
+        }
+
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+
+    void stop()
+    {
+        pthread_mutex_lock(&lock);
+        closed = true;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+
+        for (size_t i = 0; i < outputs.size(); i++)
+        {
+            if (outputs[i].started)
+                pthread_join(outputs[i].thread, 0);
+
+            outputs[i].started = false;
+        }
+    }
+
+public:
+
+    trace_fanout(const std::vector<int>& fds) :
+        outputs(fds.size()),
+        args(fds.size()),
+        current(),
+        closed(false),
+        finished(false)
+    {
+        pthread_mutex_init(&lock, 0);
+        pthread_cond_init(&cond, 0);
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            outputs[i].fd = fds[i];
+            outputs[i].started = false;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            args[i].fanout = this;
+            args[i].index = i;
+
+            if (pthread_create(&outputs[i].thread, 0, worker, &args[i]) != 0)
+            {
+                stop();
+
+                pthread_cond_destroy(&cond);
+                pthread_mutex_destroy(&lock);
+
+                throw std::runtime_error("Failed to create writer thread!");
+            }
+
+            outputs[i].started = true;
+        }
+    }
+
+    ~trace_fanout()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+    }
+
+    size_t size() const
+    {
+        return outputs.size();
+    }
+
+    // Queue a trace for all outputs. The raw header is used when not
+    // null, otherwise the header is encoded. data holds the samples of
+    // the trace for each output, which must remain valid until the
+    // fanout is finished.
+
+    void write_trace(
+        const trace_header& header,
+        const char* raw_header,
+        const char* const* data,
+        size_t size
+    )
+    {
+        if (finished)
+            throw std::runtime_error("The trace fanout is finished!");
+
+        if (!current)
+        {
+            current.reset(new detail::fanout_batch());
+            current->encoded.resize(batch_traces * su_dataset::su_header_size);
+            current->num_encoded = 0;
+            current->headers.reserve(batch_traces);
+            current->sizes.reserve(batch_traces);
+            current->data.reserve(batch_traces * outputs.size());
+        }
+
+        if (raw_header == 0)
+        {
+            char* p = &current->encoded[current->num_encoded *
+                su_dataset::su_header_size];
+
+            su_dataset::encode_header(header, p);
+
+            current->num_encoded++;
+            raw_header = p;
+        }
+
+        current->headers.push_back(raw_header);
+        current->sizes.push_back(size);
+        current->data.insert(current->data.end(), data,
+            data + outputs.size());
+
+        if (current->sizes.size() == batch_traces)
+            submit();
+    }
+
+    // Write all queued traces and wait for the writers. Errors from the
+    // outputs are combined in a single exception.
+
+    void finish()
+    {
+        if (finished)
+            return;
+
+        finished = true;
+
+        submit();
+        stop();
+
+        std::string message;
+
+        for (size_t i = 0; i < outputs.size(); i++)
+        {
+            if (outputs[i].error.size() == 0)
+                continue;
+
+            message += std::string(message.size() == 0 ? "" : "\n") +
+                "[" + boost::lexical_cast<std::string>(i) + "] " +
+                outputs[i].error;
+        }
+
+        if (message.size() != 0)
+            throw std::runtime_error(message);
+    }
+};
+
+}}
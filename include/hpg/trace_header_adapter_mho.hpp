@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header_helper_mho.hpp"
+#include "trace_header_adapter.hpp"
+
+namespace s1o_example {
+namespace io {
+
+// Create a trace_header adapter for the s1o dataset that uses midpoints
+// and absolute offset as a representation for the locations.
+
+typedef trace_header_adapter<
+    trace_header_helper_mho
+    > trace_header_adapter_mho;
+
+}}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+
+#include <cmath>
+
+namespace s1o_example {
+namespace io {
+
+// Azimuth of a half-offset vector in degrees, clockwise from the y axis
+// (north) in [0, 360), following the direction from the source to the
+// receiver. Traces with zero offset have azimuth zero.
+
+inline double half_offset_azimuth(double hx, double hy)
+{
+    double az = std::atan2(hx, hy) * (180.0 / M_PI);
+
+    return az < 0 ? az + 360.0 : az;
+}
+
+// Create a helper struct to represent a trace as a 4D point organized
+// by 2 dimensions of midpoints, the half-offset length and the azimuth,
+// so offset and azimuth ranges map directly to boxes in the index.
+
+struct trace_header_helper_mhaz
+{
+    // Number of dimensions used to represent a spatial location.
+    static const unsigned int num_spatial_dims = 4;
+
+    // A name for the helper that will be included
+    // in the check section of the dataset.
+    static const char* get_name()
+    {
+        return "helper_mhaz";
+    }
+
+    // Retrieve a location from the trace using the desired criteria.
+    template <typename TPoint>
+    static void get_location(
+        const trace_header& meta,
+        TPoint& point_out
+    )
+    {
+        double mx = (meta.RcvX + meta.SrcX) / 2.0;
+        double my = (meta.RcvY + meta.SrcY) / 2.0;
+        double hx = (meta.RcvX - meta.SrcX) / 2.0;
+        double hy = (meta.RcvY - meta.SrcY) / 2.0;
+
+        point_out.template set<0>(mx);
+        point_out.template set<1>(my);
+        point_out.template set<2>(std::sqrt(hx * hx + hy * hy));
+        point_out.template set<3>(half_offset_azimuth(hx, hy));
+    }
+};
+
+}}
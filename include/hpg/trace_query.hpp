@@ -0,0 +1,1085 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "query_to_point.hpp"
+#include "query_to_range.hpp"
+#include "query_to_shape.hpp"
+#include "query_to_offaz.hpp"
+#include "query_parser.hpp"
+#include "print_point.hpp"
+#include "dataset_chain.hpp"
+#include "dataset_5d.hpp"
+#include "trace_writer.hpp"
+#include "data_prefetcher.hpp"
+#include "query_explain.hpp"
+#include "custom_limits.hpp"
+
+#include <boost/geometry/algorithms/comparable_distance.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <deque>
+#include <vector>
+#include <cmath>
+
+namespace s1o_example {
+namespace io {
+
+// Options of the query copy routines.
+
+struct query_options
+{
+    // Write the traces of range and nearest queries in the order their
+    // data is stored in the dataset, instead of the search order.
+    bool file_order;
+
+    // Number of traces ahead of the output whose data is prefetched, or
+    // zero to read the data only when the trace is written.
+    size_t prefetch;
+
+    // Statistics of the query, or null to not collect them. The elements
+    // are always collected before being copied when explaining, so the
+    // traversal and the copy can be timed apart.
+    query_explain* explain;
+
+    query_options() :
+        file_order(true),
+        prefetch(128),
+        explain(0)
+    {
+    }
+};
+
+// Options of the outputs that only read the headers. The traces are
+// taken in the search order and no data is prefetched, so only the index
+// and the metadata of the dataset are read.
+
+inline query_options get_header_only_options(const query_options& options)
+{
+    query_options header_options(options);
+
+    header_options.file_order = false;
+    header_options.prefetch = 0;
+
+    return header_options;
+}
+
+// Order elements by the position of their data in the dataset.
+
+template <typename T>
+bool compare_data_offset(const T& a, const T& b)
+{
+    return a.second < b.second;
+}
+
+// Collect the elements from an iterator range in the search order.
+
+template <typename IT, typename T>
+void collect_elements(
+    IT begin,
+    IT end,
+    std::vector<T>& elements
+)
+{
+    elements.clear();
+
+    for (; begin != end; begin++)
+        elements.push_back(T(begin->first, begin->second));
+}
+
+// Collect the elements from an iterator range ordered by the position of
+// their data. The data is mapped from the dataset file, so copying the
+// traces in this order turns scattered page faults into a forward scan
+// the kernel readahead can merge into large sequential reads.
+
+template <typename IT, typename T>
+void collect_by_data_offset(
+    IT begin,
+    IT end,
+    std::vector<T>& elements
+)
+{
+    collect_elements(begin, end, elements);
+
+    std::sort(elements.begin(), elements.end(), compare_data_offset<T>);
+}
+
+// Queue a single trace to be written to the output. The output is a
+// trace_writer, or any other type with its own overload of copy_trace,
+// such as the outputs that only read the headers.
+
+template <typename MA, typename W>
+void copy_trace(
+    const trace_header& header,
+    const char* data,
+    const MA& meta_adapter,
+    const s1o_example::io::su_header_column* column,
+    W& writer
+)
+{
+    size_t size = meta_adapter.get_data_size(header);
+
+    if (column != 0)
+        writer.write_trace_raw(column->get(header.Id), data, size);
+    else
+        writer.write_trace(header, data, size);
+}
+
+// Copy traces to the output from element iterators, using the
+// pre-encoded headers from the column if it is not null. When prefetch
+// is not zero, the data of up to that many traces ahead of the output is
+// requested from the kernel in the background, so reading the data
+// overlaps with encoding and writing the previous traces.
+
+template <typename IT, typename MA, typename W>
+size_t copy_traces(
+    IT begin,
+    IT end,
+    size_t ndelta,
+    const MA& meta_adapter,
+    const s1o_example::io::su_header_column* column,
+    size_t prefetch,
+    W& writer
+)
+{
+    using namespace s1o_example::io;
+
+    typedef std::pair<
+        typename MA::metadata_type*,
+        char*
+        > dataset_element_pair;
+
+    size_t n = 0;
+
+    if (prefetch == 0)
+    {
+        for (; begin != end; begin++, n++)
+        {
+            if (((n + 1) % ndelta) == 0) {
+                std::cerr
+                    << ".";
+            }
+
+            // Queue the raw trace data to be written to the output.
+
+            copy_trace(*begin->first, begin->second, meta_adapter, column,
+                writer);
+        }
+
+        return n;
+    }
+
+    data_prefetcher prefetcher;
+    std::deque<dataset_element_pair> ahead;
+
+    for (;;)
+    {
+        // Refill the window once half of it was consumed, so the
+        // prefetch requests are issued in batches.
+
+        if (ahead.size() <= prefetch / 2)
+        {
+            for (; begin != end && ahead.size() < prefetch; begin++)
+            {
+                ahead.push_back(dataset_element_pair(begin->first,
+                    begin->second));
+
+                prefetcher.advise(begin->second,
+                    meta_adapter.get_data_size(*begin->first));
+            }
+
+            prefetcher.flush();
+        }
+
+        if (ahead.empty())
+            break;
+
+        if (((n + 1) % ndelta) == 0) {
+            std::cerr
+                << ".";
+        }
+
+        copy_trace(*ahead.front().first, ahead.front().second,
+            meta_adapter, column, writer);
+
+        ahead.pop_front();
+        n++;
+    }
+
+    return n;
+}
+
+// Copy the traces of collected elements, recording them in the
+// statistics of the query if it is being explained.
+
+template <typename T, typename MA, typename W>
+size_t copy_collected_traces(
+    const std::vector<T>& elements,
+    size_t ndelta,
+    const MA& meta_adapter,
+    const s1o_example::io::su_header_column* column,
+    size_t prefetch,
+    query_explain* explain,
+    W& writer
+)
+{
+    if (explain != 0)
+        explain->begin_copy(elements.begin(), elements.end(), meta_adapter);
+
+    size_t n = copy_traces(elements.begin(), elements.end(), ndelta,
+        meta_adapter, column, prefetch, writer);
+
+    if (explain != 0)
+        explain->end_copy();
+
+    return n;
+}
+
+// Copy the entire file without any query.
+
+template <typename D, typename W>
+size_t copy_traces_no_query(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    W& writer
+)
+{
+    using namespace s1o_example::io;
+
+    typedef typename D::elem_l_iterator_slot dataset_iterator;
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < chain.size(); i++)
+    {
+        const D& inds = chain[i];
+
+        // Get the iterators to all elements in the dataset,
+        // at the specific slot.
+
+        dataset_iterator begin = inds.begin_elements(slot);
+        dataset_iterator end = inds.end_elements(slot);
+
+        n += copy_traces(begin, end, ndelta, inds.get_meta_adapter(),
+            chain.get_header_column(i), 0, writer);
+    }
+
+    return n;
+}
+
+// Copy the file with a range query.
+
+template <typename D, typename W>
+size_t copy_traces_range(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::io;
+    using namespace s1o_example::misc;
+    using namespace s1o_example::query;
+
+    typedef typename D::elem_q_iterator_slot dataset_iterator;
+    typedef typename D::spatial_point_type point;
+
+    // Parse and print the query points.
+
+    point p1, p2;
+    query_to_range(query, p1, p2);
+
+    log
+        << "Selecting points in range:"
+        << std::endl;
+
+    log << "  from: ";
+    print_point(p1, log);
+    log << "..." << std::endl;
+    log << "  to:   ";
+    print_point(p2, log);
+    log << "..." << std::endl;
+
+    std::vector<typename D::element_pair> elements;
+    query_explain* explain = options.explain;
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < chain.size(); i++)
+    {
+        const D& inds = chain[i];
+
+        if (explain != 0)
+            explain->begin_traversal();
+
+        // Get the iterators to the range query at the specific slot.
+
+        dataset_iterator begin = inds.begin_query_elements(p1, p2, slot);
+        dataset_iterator end = inds.end_query_elements(slot);
+
+        if (options.file_order || explain != 0)
+        {
+            if (options.file_order)
+                collect_by_data_offset(begin, end, elements);
+            else
+                collect_elements(begin, end, elements);
+
+            if (explain != 0)
+                explain->end_traversal(elements.size());
+
+            n += copy_collected_traces(elements, ndelta,
+                inds.get_meta_adapter(), chain.get_header_column(i),
+                options.prefetch, explain, writer);
+        }
+        else
+        {
+            n += copy_traces(begin, end, ndelta, inds.get_meta_adapter(),
+                chain.get_header_column(i), options.prefetch, writer);
+        }
+    }
+
+    return n;
+}
+
+// Parse the number of nearest neighbors to search, the last element of
+// a nearest query.
+
+inline size_t get_nearest_count(
+    const s1o_example::query::query_parser& query
+)
+{
+    using namespace s1o_example::query;
+
+    const query_element& elem_nearest = query.get_query_element(
+        query.get_num_query_elements() - 1);
+
+    if (elem_nearest.is_value_empty())
+        throw std::runtime_error("Missing number of nearest points!");
+
+    if (elem_nearest.num_values() != 1)
+        throw std::runtime_error("Expect nearest as a single value!");
+
+    return elem_nearest.get_value_as<size_t>();
+}
+
+// Order k-nearest neighbors candidates by their distance.
+
+template <typename T>
+bool compare_candidates(const T& a, const T& b)
+{
+    return a.first < b.first;
+}
+
+// Copy the file with a k-nearest neighbors query.
+
+template <typename D, typename W>
+size_t copy_traces_nearest(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::io;
+    using namespace s1o_example::misc;
+    using namespace s1o_example::query;
+
+    typedef typename D::elem_q_iterator_slot dataset_iterator;
+    typedef typename D::element_pair dataset_element_pair;
+    typedef typename D::spatial_point_type point;
+
+    // Parse the query point.
+
+    point p;
+    query_to_point(query, p);
+
+    // Parse the number of nearest neighbors to search.
+
+    size_t nearest = get_nearest_count(query);
+
+    // Print the query parameters.
+
+    log
+        << "Selecting "
+        << nearest
+        << " nearest points to:"
+        << std::endl;
+
+    log << "  point: ";
+    print_point(p, log);
+    log << "..." << std::endl;
+
+    const typename D::meta_adapter_type& meta_adapter =
+        chain[0].get_meta_adapter();
+
+    query_explain* explain = options.explain;
+
+    // Get the iterators to the KNN query at the specific slot.
+
+    if (chain.size() == 1)
+    {
+        if (explain != 0)
+            explain->begin_traversal();
+
+        dataset_iterator begin = chain[0].begin_query_elements(p,
+            nearest, slot);
+        dataset_iterator end = chain[0].end_query_elements(slot);
+
+        if (options.file_order || explain != 0)
+        {
+            std::vector<dataset_element_pair> elements;
+
+            if (options.file_order)
+                collect_by_data_offset(begin, end, elements);
+            else
+                collect_elements(begin, end, elements);
+
+            if (explain != 0)
+                explain->end_traversal(elements.size());
+
+            return copy_collected_traces(elements, ndelta, meta_adapter,
+                chain.get_header_column(0), options.prefetch, explain,
+                writer);
+        }
+
+        return copy_traces(begin, end, ndelta, meta_adapter,
+            chain.get_header_column(0), options.prefetch, writer);
+    }
+
+    // With appended deltas, the k nearest traces are searched in every
+    // part and the k nearest among them are selected.
+
+    typedef std::pair<double, dataset_element_pair> candidate;
+
+    std::vector<candidate> candidates;
+
+    for (size_t i = 0; i < chain.size(); i++)
+    {
+        const D& inds = chain[i];
+
+        if (explain != 0)
+            explain->begin_traversal();
+
+        size_t part_candidates = candidates.size();
+
+        dataset_iterator begin = inds.begin_query_elements(p, nearest, slot);
+        dataset_iterator end = inds.end_query_elements(slot);
+
+        for (; begin != end; begin++)
+        {
+            point location;
+            meta_adapter.get_location(*begin->first, location);
+
+            candidates.push_back(candidate(
+                boost::geometry::comparable_distance(p, location),
+                dataset_element_pair(begin->first, begin->second)));
+        }
+
+        if (explain != 0)
+            explain->end_traversal(candidates.size() - part_candidates);
+    }
+
+    size_t k = std::min(nearest, candidates.size());
+
+    std::partial_sort(candidates.begin(), candidates.begin() + k,
+        candidates.end(), compare_candidates<candidate>);
+
+    std::vector<dataset_element_pair> traces;
+
+    for (size_t i = 0; i < k; i++)
+        traces.push_back(candidates[i].second);
+
+    if (options.file_order)
+    {
+        std::sort(traces.begin(), traces.end(),
+            compare_data_offset<dataset_element_pair>);
+    }
+
+    // The selected traces may come from different parts, so their headers
+    // are encoded instead of taken from the header columns.
+
+    return copy_collected_traces(traces, ndelta, meta_adapter, 0,
+        options.prefetch, explain, writer);
+}
+
+// Check whether a dataset has a trace at exactly the given point with a
+// degenerate range query, which reports absence without an exception.
+
+template <typename D, typename P>
+bool has_element_at(const D& inds, const P& p, size_t slot)
+{
+    return inds.begin_query_elements(p, p, slot) !=
+        inds.end_query_elements(slot);
+}
+
+// Find the trace at exactly the point p at the specific slot, searching
+// the appended deltas in order if it is not in the base dataset, and set
+// part to the index of the part holding it. Only the part holding the
+// point, or the last one, is asked for the element, so any other error
+// of find_element is not mistaken for a missing trace.
+
+template <typename D, typename P>
+typename D::element_pair find_exact_element(
+    const s1o_example::io::dataset_chain<D>& chain,
+    const P& p,
+    size_t slot,
+    query_explain* explain,
+    size_t& part
+)
+{
+    for (size_t i = 0;; i++)
+    {
+        if (explain != 0)
+            explain->begin_traversal();
+
+        if (i + 1 == chain.size() || has_element_at(chain[i], p, slot))
+        {
+            typename D::element_pair element = chain[i].find_element(p,
+                slot);
+
+            if (explain != 0)
+                explain->end_traversal(1);
+
+            part = i;
+
+            return element;
+        }
+
+        if (explain != 0)
+            explain->end_traversal(0);
+    }
+}
+
+// Copy the trace at the exact position specified in the query.
+
+template <typename D, typename W>
+size_t copy_traces_exact(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::io;
+    using namespace s1o_example::misc;
+    using namespace s1o_example::query;
+
+    typedef typename D::element_pair dataset_element_pair;
+    typedef typename D::spatial_point_type point;
+
+    // Parse and print the query point.
+
+    point p;
+    query_to_point(query, p);
+
+    log
+        << "Selecting exactly the point:"
+        << std::endl;
+
+    log << "  at: ";
+    print_point(p, log);
+    log << "..." << std::endl;
+
+    // Get the exact element at the specific slot.
+
+    query_explain* explain = options.explain;
+
+    size_t i;
+
+    std::vector<dataset_element_pair> trace(1, find_exact_element(chain, p,
+        slot, explain, i));
+
+    return copy_collected_traces(trace, ndelta, chain[i].get_meta_adapter(),
+        chain.get_header_column(i), 0, explain, writer);
+}
+
+namespace detail_trace_query {
+
+// The selectors test the traces by their midpoints and half-offsets.
+
+typedef s1o_example::io::dataset_layout<
+    s1o_example::io::trace_header_helper_mhxy
+    >::type::spatial_point_type selector_point;
+
+// Convert a coordinate to the range of the coordinate type of P.
+
+template <typename P>
+double clamp_coordinate(double value)
+{
+    typedef typename boost::geometry::traits::
+        coordinate_type<P>::type value_type;
+
+    typedef s1o_example::misc::custom_limits<value_type> nl;
+
+    return std::max(std::min(value, static_cast<double>(nl::highest())),
+        static_cast<double>(nl::lowest()));
+}
+
+// Pad a half-offset range, since the index stores the lengths computed
+// from the headers while the selectors compute them from the rounded
+// half-offset coordinates.
+
+inline double pad_half_offset(double h)
+{
+    return 1e-5 * (std::fabs(h) + 1);
+}
+
+const double azimuth_pad = 1e-3;
+
+// Ranges of the dataset points of a layout containing all the traces
+// accepted by a selector. The selectors describe their selection by
+// midpoint boxes, a half-offset length range and azimuth sectors, which
+// each layout maps to its own coordinates. Layouts without a mapping
+// visit the whole index and rely on the exact test.
+
+template <typename H>
+struct selector_ranges
+{
+    template <typename S, typename P>
+    static void get(const S& selector, std::vector<std::pair<P, P> >& ranges)
+    {
+        (void)selector;
+        ranges.resize(1);
+        s1o_example::query::open_range(ranges[0].first, ranges[0].second);
+    }
+};
+
+// (mx, my, hx, hy), given directly by the selectors.
+
+template <>
+struct selector_ranges<s1o_example::io::trace_header_helper_mhxy>
+{
+    template <typename S, typename P>
+    static void get(const S& selector, std::vector<std::pair<P, P> >& ranges)
+    {
+        selector.get_ranges(ranges);
+    }
+};
+
+// (mx, my, h, azimuth), with a range per midpoint box and azimuth sector.
+
+template <>
+struct selector_ranges<s1o_example::io::trace_header_helper_mhaz>
+{
+    template <typename S, typename P>
+    static void get(const S& selector, std::vector<std::pair<P, P> >& ranges)
+    {
+        using namespace s1o_example::query;
+
+        std::vector<midpoint_box_type> boxes;
+        std::vector<std::pair<double, double> > sectors;
+        double hmin, hmax;
+
+        selector.get_midpoint_boxes(boxes);
+        selector.get_half_offset_range(hmin, hmax);
+        selector.get_azimuth_sectors(sectors);
+
+        ranges.clear();
+
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            for (size_t j = 0; j < sectors.size(); j++)
+            {
+                P p1, p2;
+
+                p1.template set<0>(clamp_coordinate<P>(
+                    boxes[i].min_corner().x()));
+                p1.template set<1>(clamp_coordinate<P>(
+                    boxes[i].min_corner().y()));
+                p1.template set<2>(clamp_coordinate<P>(
+                    hmin - pad_half_offset(hmin)));
+                p1.template set<3>(sectors[j].first - azimuth_pad);
+
+                p2.template set<0>(clamp_coordinate<P>(
+                    boxes[i].max_corner().x()));
+                p2.template set<1>(clamp_coordinate<P>(
+                    boxes[i].max_corner().y()));
+                p2.template set<2>(clamp_coordinate<P>(
+                    hmax + pad_half_offset(hmax)));
+                p2.template set<3>(sectors[j].second + azimuth_pad);
+
+                ranges.push_back(std::make_pair(p1, p2));
+            }
+        }
+    }
+};
+
+// (mx, my, offset), where the offset is twice the half-offset length.
+
+template <>
+struct selector_ranges<s1o_example::io::trace_header_helper_mho>
+{
+    template <typename S, typename P>
+    static void get(const S& selector, std::vector<std::pair<P, P> >& ranges)
+    {
+        using namespace s1o_example::query;
+
+        std::vector<midpoint_box_type> boxes;
+        double hmin, hmax;
+
+        selector.get_midpoint_boxes(boxes);
+        selector.get_half_offset_range(hmin, hmax);
+
+        ranges.resize(boxes.size());
+
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            P& p1 = ranges[i].first;
+            P& p2 = ranges[i].second;
+
+            p1.template set<0>(clamp_coordinate<P>(
+                boxes[i].min_corner().x()));
+            p1.template set<1>(clamp_coordinate<P>(
+                boxes[i].min_corner().y()));
+            p1.template set<2>(clamp_coordinate<P>(
+                2 * (hmin - pad_half_offset(hmin))));
+
+            p2.template set<0>(clamp_coordinate<P>(
+                boxes[i].max_corner().x()));
+            p2.template set<1>(clamp_coordinate<P>(
+                boxes[i].max_corner().y()));
+            p2.template set<2>(clamp_coordinate<P>(
+                2 * (hmax + pad_half_offset(hmax))));
+        }
+    }
+};
+
+template <typename S, typename P>
+void get_selector_ranges(
+    const S& selector,
+    std::vector<std::pair<P, P> >& ranges
+)
+{
+    selector_ranges<s1o_example::io::dataset_5d_helper>::get(selector,
+        ranges);
+}
+
+// Order elements by the uid of their traces.
+
+template <typename T>
+bool compare_uid(const T& a, const T& b)
+{
+    return a.first->Id < b.first->Id;
+}
+
+template <typename T>
+bool equal_uid(const T& a, const T& b)
+{
+    return a.first->Id == b.first->Id;
+}
+
+}
+
+// Copy the traces accepted by a selector. The ranges given by the
+// selector are used as queries, so the index only visits the subtrees
+// that may contain selected traces, and the exact test is done on the
+// headers before any data is read. Traces found by more than one range
+// are only copied once, in which case the search order is replaced by
+// the order of the uids.
+
+template <typename D, typename S, typename W>
+size_t copy_traces_selector(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const S& selector,
+    const query_options& options,
+    W& writer
+)
+{
+    using namespace s1o_example::io;
+
+    typedef typename D::elem_q_iterator_slot dataset_iterator;
+    typedef typename D::element_pair dataset_element_pair;
+    typedef typename D::spatial_point_type point;
+
+    std::vector<std::pair<point, point> > ranges;
+    detail_trace_query::get_selector_ranges(selector, ranges);
+
+    std::vector<dataset_element_pair> elements;
+    query_explain* explain = options.explain;
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < chain.size(); i++)
+    {
+        const D& inds = chain[i];
+        const typename D::meta_adapter_type& meta_adapter =
+            inds.get_meta_adapter();
+
+        if (explain != 0)
+            explain->begin_traversal();
+
+        size_t part_candidates = 0;
+
+        elements.clear();
+
+        for (size_t r = 0; r < ranges.size(); r++)
+        {
+            dataset_iterator begin = inds.begin_query_elements(
+                ranges[r].first, ranges[r].second, slot);
+            dataset_iterator end = inds.end_query_elements(slot);
+
+            for (; begin != end; begin++, part_candidates++)
+            {
+                detail_trace_query::selector_point location;
+                trace_header_helper_mhxy::get_location(*begin->first,
+                    location);
+
+                if (selector(location))
+                {
+                    elements.push_back(dataset_element_pair(begin->first,
+                        begin->second));
+                }
+            }
+        }
+
+        if (ranges.size() > 1)
+        {
+            std::sort(elements.begin(), elements.end(),
+                detail_trace_query::compare_uid<dataset_element_pair>);
+
+            elements.erase(std::unique(elements.begin(), elements.end(),
+                detail_trace_query::equal_uid<dataset_element_pair>),
+                elements.end());
+        }
+
+        if (options.file_order)
+        {
+            std::sort(elements.begin(), elements.end(),
+                compare_data_offset<dataset_element_pair>);
+        }
+
+        if (explain != 0)
+            explain->end_traversal(part_candidates);
+
+        n += copy_collected_traces(elements, ndelta, meta_adapter,
+            chain.get_header_column(i), options.prefetch, explain, writer);
+    }
+
+    return n;
+}
+
+// Copy the traces with midpoints inside a polygon.
+
+template <typename D, typename W>
+size_t copy_traces_polygon(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::query;
+
+    polygon_selector selector(query);
+
+    log
+        << "Selecting points with midpoints in a polygon with "
+        << query.get_num_query_elements()
+        << " vertices..."
+        << std::endl;
+
+    return copy_traces_selector(chain, slot, ndelta, selector, options,
+        writer);
+}
+
+// Copy the traces with midpoints along a corridor.
+
+template <typename D, typename W>
+size_t copy_traces_corridor(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::query;
+
+    corridor_selector selector(query);
+
+    log
+        << "Selecting points with midpoints within "
+        << selector.get_width()
+        << " of a path with "
+        << query.get_num_query_elements() - 1
+        << " vertices..."
+        << std::endl;
+
+    return copy_traces_selector(chain, slot, ndelta, selector, options,
+        writer);
+}
+
+// Copy the traces in midpoint ranges with half-offset lengths and
+// azimuths in the given ranges.
+
+template <typename D, typename W>
+size_t copy_traces_offaz(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::misc;
+    using namespace s1o_example::query;
+
+    typedef typename D::spatial_point_type point;
+
+    offaz_selector selector(query);
+
+    std::vector<std::pair<point, point> > ranges;
+    detail_trace_query::get_selector_ranges(selector, ranges);
+
+    log
+        << "Selecting points by offset and azimuth in range:"
+        << std::endl;
+
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        log << "  from: ";
+        print_point(ranges[i].first, log);
+        log << "..." << std::endl;
+        log << "  to:   ";
+        print_point(ranges[i].second, log);
+        log << "..." << std::endl;
+    }
+
+    return copy_traces_selector(chain, slot, ndelta, selector, options,
+        writer);
+}
+
+// Check that a query can be answered without copying any trace: its
+// parameters are converted and, for exact queries, the trace is found.
+// This lets a caller report an invalid query before any output is
+// written.
+
+template <typename D>
+void check_traces_query(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    const s1o_example::query::query_parser& query
+)
+{
+    using namespace s1o_example::query;
+
+    typedef typename D::spatial_point_type point;
+
+    point p1, p2;
+    size_t part;
+
+    switch(query.get_query_type())
+    {
+    case QUERY_TYPE_NONE:
+        break;
+    case QUERY_TYPE_RANGE:
+        query_to_range(query, p1, p2);
+        break;
+    case QUERY_TYPE_NEAREST:
+        query_to_point(query, p1);
+        get_nearest_count(query);
+        break;
+    case QUERY_TYPE_EXACT:
+        query_to_point(query, p1);
+        find_exact_element(chain, p1, slot, 0, part);
+        break;
+    case QUERY_TYPE_POLYGON:
+        static_cast<void>(polygon_selector(query));
+        break;
+    case QUERY_TYPE_CORRIDOR:
+        static_cast<void>(corridor_selector(query));
+        break;
+    case QUERY_TYPE_OFFAZ:
+        static_cast<void>(offaz_selector(query));
+        break;
+    default:
+        throw std::runtime_error("Unknown query type!");
+    }
+}
+
+// Copy the traces selected by a query, printing the query parameters to
+// log.
+
+template <typename D, typename W>
+size_t copy_traces_query(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    size_t ndelta,
+    const s1o_example::query::query_parser& query,
+    const query_options& options,
+    W& writer,
+    std::ostream& log
+)
+{
+    using namespace s1o_example::query;
+
+    // Select the right method from the query type (if specified).
+
+    switch(query.get_query_type())
+    {
+    case QUERY_TYPE_NONE:
+        return copy_traces_no_query(chain, slot, ndelta, writer);
+    case QUERY_TYPE_RANGE:
+        return copy_traces_range(chain, slot, ndelta, query, options,
+            writer, log);
+    case QUERY_TYPE_NEAREST:
+        return copy_traces_nearest(chain, slot, ndelta, query, options,
+            writer, log);
+    case QUERY_TYPE_EXACT:
+        return copy_traces_exact(chain, slot, ndelta, query, options,
+            writer, log);
+    case QUERY_TYPE_POLYGON:
+        return copy_traces_polygon(chain, slot, ndelta, query, options,
+            writer, log);
+    case QUERY_TYPE_CORRIDOR:
+        return copy_traces_corridor(chain, slot, ndelta, query, options,
+            writer, log);
+    case QUERY_TYPE_OFFAZ:
+        return copy_traces_offaz(chain, slot, ndelta, query, options,
+            writer, log);
+    default:
+        throw std::runtime_error("Unknown query type!");
+    }
+}
+
+}}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#pragma once
+
+#include "trace_header.hpp"
+#include "su.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+namespace s1o_example {
+namespace io {
+
+// Write SU traces to a file descriptor in large batches. The headers are
+// encoded together to an internal buffer (or taken pre-encoded from a
+// header column) and the samples are referenced directly from the
+// dataset, then everything is written with a single writev call per
+// batch.
+//
+// When zero-copy is requested and the output is a pipe, the batches are
+// moved to the pipe with vmsplice instead, so the samples are never
+// copied by the kernel. In this mode the samples must not change while
+// the writer exists, which holds for the read-only dataset mappings. The
+// pipe also references the encoded headers until the reader consumes
+// them, possibly after the writer is destroyed, so the header buffers are
+// mapped separately instead of taken from the heap: once unmapped, their
+// pages live on in the pipe and are never handed to another allocation.
+
+class trace_writer
+{
+private:
+
+    // Maximum number of headers encoded before the batch is written.
+    static const size_t batch_headers = 512;
+
+    int fd;
+    bool splice;
+    size_t pipe_slots;
+    std::vector<struct iovec> iov;
+    char* arenas[2];
+    size_t arena_size;
+    size_t arena;
+    size_t arena_used;
+    std::vector<trace_header> pending;
+    uint64_t bytes_written;
+
+    // The header buffers are owned by a single object.
+    trace_writer(const trace_writer&);
+    trace_writer& operator=(const trace_writer&);
+
+    void unmap_arenas()
+    {
+        for (size_t i = 0; i < 2; i++)
+        {
+            if (arenas[i] != 0)
+                munmap(arenas[i], arena_size);
+
+            arenas[i] = 0;
+        }
+    }
+
+    void push(const char* p, size_t size)
+    {
+        if (size == 0)
+            return;
+
+        struct iovec v;
+        v.iov_base = const_cast<char*>(p);
+        v.iov_len = size;
+
+        iov.push_back(v);
+    }
+
+    // Write a batch of buffers handling partial writes.
+
+    void write_all(struct iovec* v, size_t n)
+    {
+        const size_t max_iov = IOV_MAX;
+
+        while (n != 0)
+        {
+            size_t m = std::min(n, max_iov);
+
+            ssize_t written = splice ?
+                vmsplice(fd, v, m, 0) :
+                writev(fd, v, static_cast<int>(m));
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    throw std::runtime_error(
+                        "Timed out writing traces to the output!");
+                }
+
+                throw std::runtime_error(
+                    "Failed to write traces to the output!");
+            }
+
+            bytes_written += static_cast<uint64_t>(written);
+
+            size_t remaining = static_cast<size_t>(written);
+
+            while (n != 0 && remaining >= v->iov_len)
+            {
+                remaining -= v->iov_len;
+                v++;
+                n--;
+            }
+
+            if (n != 0)
+            {
+                v->iov_base = static_cast<char*>(v->iov_base) + remaining;
+                v->iov_len -= remaining;
+            }
+        }
+    }
+
+public:
+
+    trace_writer(int fd, bool zero_copy=false) :
+        fd(fd),
+        splice(false),
+        pipe_slots(0),
+        iov(),
+        arena_size(0),
+        arena(0),
+        arena_used(0),
+        pending(),
+        bytes_written(0)
+    {
+        struct stat st;
+
+        if (zero_copy && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+            long page_size = sysconf(_SC_PAGESIZE);
+
+            if (pipe_size > 0 && page_size > 0)
+            {
+                splice = true;
+                pipe_slots = static_cast<size_t>(pipe_size / page_size);
+            }
+        }
+
+        // A header buffer is only reused after the other one was filled.
+        // With vmsplice, the pipe references the header memory until the
+        // reader consumes it, so each buffer must hold more headers than
+        // the pipe has slots, guaranteeing the old headers were consumed.
+
+        size_t nheaders = batch_headers;
+
+        if (nheaders < pipe_slots + 1)
+            nheaders = pipe_slots + 1;
+
+        arena_size = nheaders * su_dataset::su_header_size;
+        arenas[0] = 0;
+        arenas[1] = 0;
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            void* p = mmap(0, arena_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (p == MAP_FAILED)
+            {
+                unmap_arenas();
+                throw std::runtime_error(
+                    "Failed to allocate the header buffers!");
+            }
+
+            arenas[i] = static_cast<char*>(p);
+        }
+
+        iov.reserve(2 * batch_headers);
+        pending.reserve(nheaders);
+    }
+
+    ~trace_writer()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+
+        unmap_arenas();
+    }
+
+    bool is_zero_copy() const
+    {
+        return splice;
+    }
+
+    uint64_t get_bytes_written() const
+    {
+        return bytes_written;
+    }
+
+    // Queue a trace to be written. The samples are not copied and must
+    // remain valid until the writer is flushed (or, in zero-copy mode,
+    // destroyed).
+
+    void write_trace(
+        const trace_header& header,
+        const char* data,
+        size_t size
+    )
+    {
+        if (arena_used == arena_size)
+        {
+            flush();
+
+            if (splice)
+                arena = 1 - arena;
+
+            arena_used = 0;
+        }
+
+        // The header is only encoded when the batch is written, together
+        // with the other pending headers.
+
+        char* p = arenas[arena] + arena_used;
+
+        arena_used += su_dataset::su_header_size;
+        pending.push_back(header);
+
+        push(p, su_dataset::su_header_size);
+        push(data, size);
+
+        if (iov.size() >= 2 * batch_headers)
+            flush();
+    }
+
+    // Queue a trace with a pre-encoded raw SU header. Both the header and
+    // the samples are not copied and have the same lifetime requirements.
+
+    void write_trace_raw(
+        const char* raw_header,
+        const char* data,
+        size_t size
+    )
+    {
+        push(raw_header, su_dataset::su_header_size);
+        push(data, size);
+
+        if (iov.size() >= 2 * batch_headers)
+            flush();
+    }
+
+    // Write all queued traces to the output.
+
+    void flush()
+    {
+        if (iov.empty())
+            return;
+
+        // Encode the pending headers, which were queued to consecutive
+        // positions of the current header buffer.
+
+        if (!pending.empty())
+        {
+            size_t first = arena_used - pending.size() *
+                su_dataset::su_header_size;
+
+            for (size_t i = 0; i < pending.size(); i++)
+            {
+                su_dataset::encode_header(pending[i], arenas[arena] + first +
+                    i * su_dataset::su_header_size);
+            }
+
+            pending.clear();
+        }
+
+        write_all(&iov[0], iov.size());
+
+        iov.clear();
+
+        // Without vmsplice the data was copied by the kernel, so the
+        // header buffer can be reused right away.
+
+        if (!splice)
+            arena_used = 0;
+    }
+};
+
+}}
@@ -18,112 +18,349 @@
  * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include "hpg/dataset_5d.hpp"
+#include "hpg/dataset_chain.hpp"
+#include "hpg/dataset_variants.hpp"
+#include "hpg/trace_writer.hpp"
+#include "hpg/trace_fanout.hpp"
+#include "hpg/header_writer.hpp"
+#include "hpg/trace_query.hpp"
+#include "hpg/phase_profile.hpp"
 #include "hpg/su.hpp"
 
 #include <boost/lexical_cast.hpp>
 
 #include <stdexcept>
 #include <iostream>
+#include <cstring>
 #include <vector>
 
+#include <fcntl.h>
 #include <unistd.h>
 
-// This program will unpack the headers and data of a single SU file
-// stored inside the s1o dataset.
-
-int main(int argc, const char* argv[])
+// Copy several slots of all datasets in the chain to their outputs in a
+// single traversal of the index. The headers are taken from the first
+// slot and the samples of the other slots are located by uid.
+
+template <typename D>
+size_t copy_slots(
+    const s1o_example::io::dataset_chain<D>& chain,
+    const std::vector<size_t>& slots,
+    size_t ndelta,
+    s1o_example::io::trace_fanout& fanout
+)
 {
     using namespace s1o_example::io;
 
-    if (argc != 4)
+    typedef typename D::elem_l_iterator_slot dataset_iterator;
+
+    std::vector<const char*> data(slots.size());
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < chain.size(); i++)
     {
-        std::cerr
-            << "USAGE: PROGRAM s1ofile nslots slot > sufile"
-            << std::endl;
-        return 1;
+        const D& inds = chain[i];
+
+        const su_header_column* column = chain.get_header_column(i);
+
+        dataset_iterator begin = inds.begin_elements(slots[0]);
+        dataset_iterator end = inds.end_elements(slots[0]);
+
+        for (; begin != end; begin++, n++)
+        {
+            if (((n + 1) % ndelta) == 0) {
+                std::cerr
+                    << ".";
+            }
+
+            const trace_header& header = *begin->first;
+
+            data[0] = begin->second;
+
+            for (size_t j = 1; j < slots.size(); j++)
+            {
+                const trace_header* p_header;
+
+                inds.get_element(header.Id, slots[j], p_header, data[j]);
+            }
+
+            fanout.write_trace(header, column != 0 ?
+                column->get(header.Id) : 0, &data[0],
+                inds.get_meta_adapter().get_data_size(header));
+        }
     }
 
-    // Ensure binary data does not output to terminal.
+    // Ensure all traces were written to the outputs.
+
+    fanout.finish();
+
+    return n;
+}
+
+// Open a dataset with the type of its rtree variant and extract the
+// selected slots.
+
+struct slot_extractor
+{
+    const std::string& infile;
+    size_t nslots;
+    const std::vector<size_t>& slots;
+    const std::vector<std::string>& outfiles;
+    bool zero_copy;
+    bool headers_only;
+    s1o_example::io::header_format format;
+    s1o_example::misc::phase_profile& profile;
+    size_t n;
+
+    slot_extractor(
+        const std::string& infile,
+        size_t nslots,
+        const std::vector<size_t>& slots,
+        const std::vector<std::string>& outfiles,
+        bool zero_copy,
+        bool headers_only,
+        s1o_example::io::header_format format,
+        s1o_example::misc::phase_profile& profile
+    ) :
+        infile(infile),
+        nslots(nslots),
+        slots(slots),
+        outfiles(outfiles),
+        zero_copy(zero_copy),
+        headers_only(headers_only),
+        format(format),
+        profile(profile),
+        n(0)
+    {
+    }
 
-    if (isatty(fileno(stdout)))
+    template <typename D>
+    void run()
     {
+        using namespace s1o_example::io;
+
+        profile.begin("open");
+
+        dataset_chain<D> chain(infile, s1o::S1O_FLAGS_ALLOW_UNSORTED |
+            s1o::S1O_FLAGS_NO_DATA_CHECK, nslots);
+
+        profile.end();
+
+        // Extract the selected slots.
+
         std::cerr
-            << "Error: stdout must be a file or a pipe, not TTY!"
+            << "Dataset open."
             << std::endl;
-        return 1;
-    }
 
-    std::string infile(argv[1]);
-    size_t slots = boost::lexical_cast<size_t>(argv[2]);
-    size_t slot = boost::lexical_cast<size_t>(argv[3]);
+        // Show 1% of the progress at a time
 
-    // Open the s1o dataset allowing unsorted data (this program is not
-    // performance critical) and not performing any data checks (increase
-    // memory usage).
+        size_t ndelta = chain.get_max_elements() / 100;
+        ndelta = ndelta != 0 ? ndelta : 1;
 
-    std::cerr
-        << "Opening dataset "
-        << infile
-        << "..."
-        << std::endl;
+        std::cerr
+            << "Copying traces..."
+            << std::endl;
 
-    dataset_5d inds(infile, 0, s1o::S1O_FLAGS_ALLOW_UNSORTED |
-        s1o::S1O_FLAGS_NO_DATA_CHECK, slots);
+        // Only the headers are written, so the data is never read.
 
-    // Extract the selected slot.
+        if (headers_only)
+        {
+            header_writer writer(fileno(stdout), format);
 
-    std::cerr
-        << "Dataset open."
-        << std::endl;
+            profile.begin("copy");
+            n = copy_traces_no_query(chain, slots[0], ndelta, writer);
+            writer.flush();
+            profile.end(n, writer.get_bytes_written());
+            return;
+        }
 
-    // Copy the data from the s1o dataset to stdout.
+        if (slots.size() == 1 && outfiles.size() == 0)
+        {
+            // The traces are written to stdout in large batches.
 
-    typedef dataset_5d::elem_l_iterator_slot dataset_iterator;
+            trace_writer writer(fileno(stdout), zero_copy);
 
-    // Show 1% of the progress at a time
+            profile.begin("copy");
+            n = copy_traces_no_query(chain, slots[0], ndelta, writer);
+            writer.flush();
+            profile.end(n, writer.get_bytes_written());
+            return;
+        }
 
-    size_t ndelta = inds.get_max_elements() / 100;
-    ndelta = ndelta != 0 ? ndelta : 1;
+        std::vector<int> fds;
 
-    std::cerr
-        << "Copying traces..."
-        << std::endl;
+        for (size_t i = 0; i < outfiles.size(); i++)
+        {
+            int fd = open(outfiles[i].c_str(), O_WRONLY | O_CREAT |
+                O_TRUNC, 0644);
 
-    dataset_iterator begin = inds.begin_elements(slot);
-    dataset_iterator end = inds.end_elements(slot);
+            if (fd < 0)
+            {
+                for (size_t j = 0; j < fds.size(); j++)
+                    close(fds[j]);
 
-    size_t n;
+                throw std::runtime_error("Failed to open " + outfiles[i] +
+                    "!");
+            }
+
+            fds.push_back(fd);
+        }
+
+        // Each output is written by its own thread.
 
-    for (n = 0; begin != end; begin++, n++)
+        try
+        {
+            trace_fanout fanout(fds);
+
+            profile.begin("copy");
+            n = copy_slots(chain, slots, ndelta, fanout);
+            profile.end(n * slots.size());
+        }
+        catch (...)
+        {
+            for (size_t i = 0; i < fds.size(); i++)
+                close(fds[i]);
+
+            throw;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (close(fds[i]) != 0)
+                throw std::runtime_error("Failed to close " + outfiles[i] +
+                    "!");
+        }
+    }
+};
+
+// This program will unpack the headers and data of a single SU file
+// stored inside the s1o dataset, or of several SU files at once.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    // Check if the output should be moved to a pipe without copying,
+    // whether only the headers are written and in which format, and parse
+    // the optional file receiving the profile of the phases.
+
+    bool zero_copy = false;
+    bool headers_only = false;
+    header_format format = HEADER_FORMAT_SU;
+    std::string profile_file;
+    int argi = 1;
+
+    while (argc - argi > 3)
     {
-        if (((n + 1) % ndelta) == 0) {
-            std::cerr
-                << ".";
+        if (std::strcmp(argv[argi], "-z") == 0)
+        {
+            zero_copy = true;
+            argi += 1;
+            continue;
         }
 
-        const trace_header& header = *begin->first;
-        const char* data = begin->second;
+        if (std::strcmp(argv[argi], "-t") == 0)
+        {
+            profile_file = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
 
-        // Write raw trace data to stdout.
+        if (std::strcmp(argv[argi], "-H") == 0)
+        {
+            headers_only = true;
+            format = parse_header_format(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
 
-        su_dataset::write_header(header, std::cout);
+        break;
+    }
 
-        std::cout.write(data, inds.get_meta_adapter().
-            get_data_size(header));
+    // A single slot is written to stdout, while several slots are given
+    // as pairs of slot and output file.
 
-        // Ensure the trace was written to the output.
+    int nargs = argc - argi;
 
-        std::cout.flush();
+    if (nargs < 3 || (nargs != 3 && (nargs % 2) != 0) ||
+        (headers_only && nargs != 3))
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-z] [-t profile.json] s1ofile nslots slot "
+            << "> sufile"
+            << std::endl
+            << "       PROGRAM -H su|csv [-t profile.json] s1ofile nslots "
+            << "slot > headerfile"
+            << std::endl
+            << "       PROGRAM [-t profile.json] s1ofile nslots slot0 "
+            << "sufile0 "
+            << "[slot1 sufile1] ... [slotN sufileN]"
+            << std::endl;
+        return 1;
     }
 
+    bool to_stdout = nargs == 3;
+
+    // Ensure binary data does not output to terminal.
+
+    if (to_stdout && format != HEADER_FORMAT_CSV && isatty(fileno(stdout)))
+    {
+        std::cerr
+            << "Error: stdout must be a file or a pipe, not TTY!"
+            << std::endl;
+        return 1;
+    }
+
+    std::string infile(argv[argi]);
+    size_t nslots = boost::lexical_cast<size_t>(argv[argi + 1]);
+
+    std::vector<size_t> slots;
+    std::vector<std::string> outfiles;
+
+    if (to_stdout)
+    {
+        slots.push_back(boost::lexical_cast<size_t>(argv[argi + 2]));
+    }
+    else
+    {
+        for (int i = argi + 2; i < argc; i += 2)
+        {
+            slots.push_back(boost::lexical_cast<size_t>(argv[i]));
+            outfiles.push_back(argv[i + 1]);
+        }
+    }
+
+    // Open the s1o dataset and its appended deltas allowing unsorted data
+    // (this program is not performance critical) and not performing any
+    // data checks (increase memory usage), with the rtree variant it was
+    // packed with.
+
+    std::cerr
+        << "Opening dataset "
+        << infile
+        << "..."
+        << std::endl;
+
+    s1o_example::misc::phase_profile profile("s1o2su",
+        profile_file.size() != 0);
+
+    slot_extractor extractor(infile, nslots, slots, outfiles, zero_copy,
+        headers_only, format, profile);
+
+    with_dataset_variant(infile, extractor);
+
+    size_t n = extractor.n;
+
     std::cerr
         << std::endl;
 
     std::cerr
-        << "Copied " << n << " traces."
+        << "Copied " << n << " traces"
+        << (outfiles.size() > 1 ? " to each output." : ".")
         << std::endl;
 
+    profile.write_json(profile_file, n);
+
     std::cerr
         << "Done."
         << std::endl;
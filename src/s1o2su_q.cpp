@@ -18,212 +18,324 @@
  * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include "hpg/query_to_point.hpp"
-#include "hpg/query_to_range.hpp"
+#include "hpg/trace_query.hpp"
+#include "hpg/trace_aggregate.hpp"
+#include "hpg/header_writer.hpp"
 #include "hpg/query_parser.hpp"
-#include "hpg/print_point.hpp"
-#include "hpg/dataset_5d.hpp"
+#include "hpg/dataset_chain.hpp"
+#include "hpg/dataset_variants.hpp"
+#include "hpg/trace_writer.hpp"
+#include "hpg/phase_profile.hpp"
 #include "hpg/su.hpp"
 
 #include <s1o/traits/num_spatial_dims.hpp>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <stdexcept>
+#include <algorithm>
 #include <iostream>
-#include <iterator>
+#include <fstream>
+#include <limits>
+#include <cctype>
+#include <cstring>
 #include <vector>
 
+#include <fcntl.h>
 #include <unistd.h>
 
-// Copy traces to stdout from element iterators
+inline bool is_space(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
 
-template <typename IT, typename MA>
-size_t copy_traces(
-    IT begin,
-    IT end,
-    size_t ndelta,
-    const MA& meta_adapter
+// Run every query of a stream, one per line, against the opened dataset.
+// The results are written to a separate SU file per query when prefix is
+// not empty, otherwise they are concatenated to the writer. A line with
+// the index, the number of traces and the query is printed for each
+// query, so the concatenated output can be split, followed by its
+// statistics when explaining. When aggregating, the result of each query
+// is printed to stdout after a comment line with its index and the query
+// instead. Returns the number of failed queries.
+
+template <typename D>
+size_t copy_traces_batch(
+    const s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    std::istream& queries,
+    const std::string& prefix,
+    const s1o_example::io::query_options& options,
+    s1o_example::io::trace_aggregator* aggregator,
+    s1o_example::io::trace_writer& writer
 )
 {
+    using namespace s1o::traits;
     using namespace s1o_example::io;
+    using namespace s1o_example::query;
 
-    size_t n;
+    // The details of each query are not printed and the progress is not
+    // shown.
+
+    std::ostream null_log(0);
+    size_t ndelta = std::numeric_limits<size_t>::max();
 
-    for (n = 0; begin != end; begin++, n++)
+    std::string line;
+    size_t index = 0;
+    size_t nfailed = 0;
+
+    while (std::getline(queries, line))
     {
-        if (((n + 1) % ndelta) == 0) {
-            std::cerr
-                << ".";
-        }
+        // Remove the spaces, as the terminal would in single query mode.
 
-        const trace_header& header = *begin->first;
-        const char* data = begin->second;
+        line.erase(std::remove_if(line.begin(), line.end(), is_space),
+            line.end());
 
-        // Write raw trace data to stdout.
+        if (line.size() == 0 || line[0] == '#')
+            continue;
 
-        su_dataset::write_header(header, std::cout);
+        size_t n = 0;
 
-        std::cout.write(data, meta_adapter. get_data_size(header));
+        if (options.explain != 0)
+            options.explain->clear();
 
-        // Ensure the trace was written to the output.
+        try
+        {
+            query_parser query(line, num_spatial_dims<dataset_5d>::value);
 
-        std::cout.flush();
-    }
+            if (aggregator != 0)
+            {
+                aggregator->clear();
 
-    return n;
-}
+                n = aggregate_traces_query(chain, slot, query, options,
+                    *aggregator, null_log);
+            }
+            else if (prefix.size() == 0)
+            {
+                n = copy_traces_query(chain, slot, ndelta, query, options,
+                    writer, null_log);
 
-// Copy the entire file without any query.
+                writer.flush();
+            }
+            else
+            {
+                std::string outfile = prefix + "." +
+                    boost::lexical_cast<std::string>(index) + ".su";
 
-size_t copy_traces_no_query(
-    const s1o_example::io::dataset_5d& inds,
-    size_t slot,
-    size_t ndelta
-)
-{
-    using namespace s1o_example::io;
+                int fd = open(outfile.c_str(), O_WRONLY | O_CREAT |
+                    O_TRUNC, 0644);
+
+                if (fd < 0)
+                    throw std::runtime_error("Failed to open " + outfile + "!");
 
-    typedef dataset_5d::elem_l_iterator_slot dataset_iterator;
+                try
+                {
+                    trace_writer filewriter(fd);
 
-    // Get the iterators to all elements in the dataset,
-    // at the specific slot.
+                    n = copy_traces_query(chain, slot, ndelta, query,
+                        options, filewriter, null_log);
 
-    dataset_iterator begin = inds.begin_elements(slot);
-    dataset_iterator end = inds.end_elements(slot);
+                    filewriter.flush();
+                }
+                catch (...)
+                {
+                    close(fd);
+                    throw;
+                }
 
-    return copy_traces(begin, end, ndelta, inds.get_meta_adapter());
+                if (close(fd) != 0)
+                    throw std::runtime_error("Failed to close " + outfile + "!");
+            }
+
+            std::cerr
+                << index << "\t" << n << "\t" << line
+                << std::endl;
+
+            if (options.explain != 0)
+                options.explain->print(std::cerr);
+
+            if (aggregator != 0)
+            {
+                std::cout
+                    << "# " << index << "\t" << line
+                    << std::endl;
+
+                aggregator->print(std::cout);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            nfailed++;
+
+            std::cerr
+                << index << "\terror\t" << line << "\t" << e.what()
+                << std::endl;
+        }
+
+        index++;
+    }
+
+    return nfailed;
 }
 
-// Copy the file with a range query.
+// Open a dataset with the type of its rtree variant and run the query,
+// or all queries of the stream in batch mode.
 
-size_t copy_traces_range(
-    const s1o_example::io::dataset_5d& inds,
-    size_t slot,
-    size_t ndelta,
-    const s1o_example::query::query_parser& query
-)
+struct query_runner
 {
-    using namespace s1o_example::io;
-    using namespace s1o_example::misc;
-    using namespace s1o_example::query;
+    const std::string& infile;
+    size_t slots;
+    size_t slot;
+    const s1o_example::query::query_parser& query;
+    std::istream* queries;
+    const std::string& prefix;
+    const s1o_example::io::query_options& options;
+    s1o_example::io::trace_aggregator* aggregator;
+    bool zero_copy;
+    bool headers_only;
+    s1o_example::io::header_format format;
+    s1o_example::misc::phase_profile& profile;
+    size_t n;
+    size_t nfailed;
+
+    query_runner(
+        const std::string& infile,
+        size_t slots,
+        size_t slot,
+        const s1o_example::query::query_parser& query,
+        std::istream* queries,
+        const std::string& prefix,
+        const s1o_example::io::query_options& options,
+        s1o_example::io::trace_aggregator* aggregator,
+        bool zero_copy,
+        bool headers_only,
+        s1o_example::io::header_format format,
+        s1o_example::misc::phase_profile& profile
+    ) :
+        infile(infile),
+        slots(slots),
+        slot(slot),
+        query(query),
+        queries(queries),
+        prefix(prefix),
+        options(options),
+        aggregator(aggregator),
+        zero_copy(zero_copy),
+        headers_only(headers_only),
+        format(format),
+        profile(profile),
+        n(0),
+        nfailed(0)
+    {
+    }
 
-    typedef dataset_5d::elem_q_iterator_slot dataset_iterator;
-    typedef dataset_5d::spatial_point_type point;
+    template <typename D>
+    void run()
+    {
+        using namespace s1o_example::io;
 
-    // Parse and print the query points.
+        profile.begin("open");
 
-    point p1, p2;
-    query_to_range(query, p1, p2);
+        dataset_chain<D> chain(infile, s1o::S1O_FLAGS_ALLOW_UNSORTED |
+            s1o::S1O_FLAGS_NO_DATA_CHECK, slots);
 
-    std::cerr
-        << "Selecting points in range:"
-        << std::endl;
+        profile.end();
 
-    std::cerr << "  from: ";
-    print_point(p1, std::cerr);
-    std::cerr << "..." << std::endl;
-    std::cerr << "  to:   ";
-    print_point(p2, std::cerr);
-    std::cerr << "..." << std::endl;
+        // Extract the selected slot.
 
-    // Get the iterators to the range query at the specific slot.
+        std::cerr
+            << "Dataset open."
+            << std::endl;
 
-    dataset_iterator begin = inds.begin_query_elements(p1, p2, slot);
-    dataset_iterator end = inds.end_query_elements(slot);
+        // Aggregate the selected traces from their headers and print the
+        // result to stdout.
 
-    return copy_traces(begin, end, ndelta, inds.get_meta_adapter());
-}
+        if (aggregator != 0 && queries == 0)
+        {
+            profile.begin("aggregate");
 
-// Copy the file with a k-nearest neighbors query.
+            n = aggregate_traces_query(chain, slot, query, options,
+                *aggregator, std::cerr);
 
-size_t copy_traces_nearest(
-    const s1o_example::io::dataset_5d& inds,
-    size_t slot,
-    size_t ndelta,
-    const s1o_example::query::query_parser& query
-)
-{
-    using namespace s1o_example::io;
-    using namespace s1o_example::misc;
-    using namespace s1o_example::query;
+            profile.end(n);
 
-    typedef dataset_5d::elem_q_iterator_slot dataset_iterator;
-    typedef dataset_5d::spatial_point_type point;
+            aggregator->print(std::cout);
+            return;
+        }
 
-    // Parse the query point.
+        // Write only the headers of the selected traces, so the data is
+        // never read.
 
-    point p;
-    query_to_point(query, p);
+        if (headers_only)
+        {
+            header_writer writer(fileno(stdout), format);
 
-    const query_element& elem_nearest = query.get_query_element(
-        query.get_num_query_elements() - 1);
+            size_t ndelta = chain.get_max_elements() / 100;
+            ndelta = ndelta != 0 ? ndelta : 1;
 
-    if (elem_nearest.is_value_empty())
-        throw std::runtime_error("Missing number of nearest points!");
+            std::cerr
+                << "Copying headers..."
+                << std::endl;
 
-    if (elem_nearest.num_values() != 1)
-        throw std::runtime_error("Expect nearest as a single value!");
+            profile.begin("query");
 
-    // Parse the number of nearest neighbors to search.
+            n = copy_headers_query(chain, slot, ndelta, query, options,
+                writer, std::cerr);
 
-    size_t nearest = elem_nearest.get_value_as<size_t>();
+            profile.end(n, writer.get_bytes_written());
+            return;
+        }
 
-    // Print the query parameters.
+        // The traces are written to stdout in large batches.
 
-    std::cerr
-        << "Selecting "
-        << nearest
-        << " nearest points to:"
-        << std::endl;
+        trace_writer writer(fileno(stdout), zero_copy);
 
-    std::cerr << "  point: ";
-    print_point(p, std::cerr);
-    std::cerr << "..." << std::endl;
+        // Run all queries against the opened dataset in batch mode.
 
-    // Get the iterators to the KNN query at the specific slot.
+        if (queries != 0)
+        {
+            std::cerr
+                << "Running queries..."
+                << std::endl;
 
-    dataset_iterator begin = inds.begin_query_elements(p, nearest, slot);
-    dataset_iterator end = inds.end_query_elements(slot);
+            profile.begin("queries");
 
-    return copy_traces(begin, end, ndelta, inds.get_meta_adapter());
-}
+            nfailed = copy_traces_batch(chain, slot, *queries, prefix,
+                options, aggregator, writer);
 
-// Copy the trace at the exact position specified in the query.
+            writer.flush();
 
-size_t copy_traces_exact(
-    const s1o_example::io::dataset_5d& inds,
-    size_t slot,
-    size_t ndelta,
-    const s1o_example::query::query_parser& query
-)
-{
-    using namespace s1o_example::io;
-    using namespace s1o_example::misc;
-    using namespace s1o_example::query;
+            profile.end(0, writer.get_bytes_written());
+            return;
+        }
 
-    typedef dataset_5d::element_pair dataset_element_pair;
-    typedef dataset_5d::spatial_point_type point;
+        // Show 1% of the progress at a time
 
-    // Parse and print the query point.
+        size_t ndelta = chain.get_max_elements() / 100;
+        ndelta = ndelta != 0 ? ndelta : 1;
 
-    point p;
-    query_to_point(query, p);
+        std::cerr
+            << "Copying traces..."
+            << std::endl;
 
-    std::cerr
-        << "Selecting exactly the point:"
-        << std::endl;
+        // The query phase includes the traversal of the index and the
+        // output of the traces written while traversing, the output
+        // phase only what was left in the writer.
 
-    std::cerr << "  at: ";
-    print_point(p, std::cerr);
-    std::cerr << "..." << std::endl;
+        profile.begin("query");
 
-    // Get the exact element at the specific slot.
+        n = copy_traces_query(chain, slot, ndelta, query, options,
+            writer, std::cerr);
 
-    dataset_element_pair trace = inds.find_element(p, slot);
+        profile.end(n);
 
-    return copy_traces(&trace, &trace, ndelta, inds.get_meta_adapter());
-}
+        // Ensure all traces were written to the output.
+
+        profile.begin("output");
+        writer.flush();
+        profile.end(n, writer.get_bytes_written());
+    }
+};
 
 // This program will unpack the headers and data of a single SU file
 // stored inside the s1o dataset.
@@ -234,10 +346,132 @@ int main(int argc, const char* argv[])
     using namespace s1o_example::io;
     using namespace s1o_example::query;
 
-    if (argc < 4)
+    // Check if the output should be moved to a pipe without copying,
+    // whether the queries are read from a file, whether the results of
+    // each query go to a separate file, whether the traces keep the
+    // order of the search instead of the order of the data file, how
+    // many traces ahead of the output are prefetched, whether the
+    // statistics of the queries are printed, whether the selected traces
+    // are aggregated instead of written, whether only their headers are
+    // written and in which format, and the file receiving the profile of
+    // the phases.
+
+    query_options options;
+    query_explain explain;
+    bool zero_copy = false;
+    std::string queryfile;
+    std::string prefix;
+    std::string profile_file;
+    std::string aggregate;
+    bool headers_only = false;
+    header_format format = HEADER_FORMAT_SU;
+    int argi = 1;
+
+    while (argc - argi > 3)
+    {
+        if (std::strcmp(argv[argi], "-z") == 0)
+        {
+            zero_copy = true;
+            argi += 1;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-s") == 0)
+        {
+            options.file_order = false;
+            argi += 1;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-e") == 0)
+        {
+            options.explain = &explain;
+            argi += 1;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-p") == 0)
+        {
+            options.prefetch = boost::lexical_cast<size_t>(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-f") == 0)
+        {
+            queryfile = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-o") == 0)
+        {
+            prefix = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-t") == 0)
+        {
+            profile_file = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-a") == 0)
+        {
+            aggregate = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-H") == 0)
+        {
+            headers_only = true;
+            format = parse_header_format(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+
+        break;
+    }
+
+    bool batch = queryfile.size() != 0;
+
+    if (argc - argi < 3 || (batch && argc - argi != 3) ||
+        (!batch && prefix.size() != 0) ||
+        (aggregate.size() != 0 && prefix.size() != 0) ||
+        (headers_only && (batch || aggregate.size() != 0)))
     {
         std::cerr
-            << "USAGE: PROGRAM s1ofile nslots slot [query] > sufile"
+            << "USAGE: PROGRAM [-e] [-s] [-z] [-p depth] [-t profile.json] "
+            << "s1ofile nslots slot [query] > sufile"
+            << std::endl
+            << "       PROGRAM [-e] [-s] [-z] [-p depth] [-t profile.json] "
+            << "-f queryfile s1ofile nslots slot > sufile"
+            << std::endl
+            << "       PROGRAM [-e] [-s] [-p depth] [-t profile.json] "
+            << "-f queryfile -o prefix s1ofile nslots slot"
+            << std::endl
+            << "       PROGRAM -a aggregate [-e] [-t profile.json] "
+            << "[-f queryfile] s1ofile nslots slot [query]"
+            << std::endl
+            << "       PROGRAM -H su|csv [-e] [-t profile.json] s1ofile "
+            << "nslots slot [query] > headerfile"
+            << std::endl
+            << "AGGREGATES:"
+            << std::endl
+            << "  count"
+            << std::endl
+            << "  bbox"
+            << std::endl
+            << "  fold[,dx,dy]"
+            << std::endl
+            << "  hist,field[,width]"
+            << std::endl
+            << "HEADER FIELDS:"
+            << std::endl
+            << "  " << get_header_field_names()
             << std::endl
             << "QUERY FORMAT:"
             << std::endl
@@ -247,6 +481,12 @@ int main(int argc, const char* argv[])
             << std::endl
             << "  at(c0,c1,cN)"
             << std::endl
+            << "  polygon(mx0:my0,mx1:my1,mx2:my2,mxN:myN)"
+            << std::endl
+            << "  corridor(mx0:my0,mx1:my1,mxN:myN,width)"
+            << std::endl
+            << "  offaz(Rmx,Rmy,Rh,Raz)"
+            << std::endl
             << "R (RANGE SPEC) FORMAT:"
             << "  ci-cf"
             << std::endl
@@ -255,13 +495,24 @@ int main(int argc, const char* argv[])
             << "  -cf"
             << std::endl
             << "  -"
+            << std::endl
+            << "QUERY FILE FORMAT:"
+            << std::endl
+            << "  one query per line, - reads the queries from stdin"
             << std::endl;
         return 1;
     }
 
+    // Parse the aggregate before opening the dataset, so a wrong spec
+    // fails fast.
+
+    boost::scoped_ptr<trace_aggregator> aggregator(aggregate.size() != 0 ?
+        new trace_aggregator(aggregate) : 0);
+
     // Ensure binary data does not output to terminal.
 
-    if (isatty(fileno(stdout)))
+    if (prefix.size() == 0 && !aggregator && format != HEADER_FORMAT_CSV &&
+        isatty(fileno(stdout)))
     {
         std::cerr
             << "Error: stdout must be a file or a pipe, not TTY!"
@@ -269,22 +520,36 @@ int main(int argc, const char* argv[])
         return 1;
     }
 
-    std::string infile(argv[1]);
-    size_t slots = boost::lexical_cast<size_t>(argv[2]);
-    size_t slot = boost::lexical_cast<size_t>(argv[3]);
+    std::string infile(argv[argi]);
+    size_t slots = boost::lexical_cast<size_t>(argv[argi + 1]);
+    size_t slot = boost::lexical_cast<size_t>(argv[argi + 2]);
 
     // Assemble the query back in case it was split by the terminal.
 
     std::string querystr;
 
-    for (size_t i = 4; i < argc; i++)
+    for (int i = argi + 3; i < argc; i++)
         querystr += argv[i];
 
-    query_parser query(querystr, num_spatial_dims<dataset_5d>::value);
+    query_parser query(batch ? "" : querystr,
+        num_spatial_dims<dataset_5d>::value);
+
+    // Open the query file before the dataset, so a wrong name fails fast.
 
-    // Open the s1o dataset allowing unsorted data (this program is not
-    // performance critical) and not performing any data checks (increase
-    // memory usage).
+    std::ifstream queryfilestream;
+
+    if (batch && queryfile != "-")
+    {
+        queryfilestream.open(queryfile.c_str());
+
+        if (!queryfilestream.is_open())
+            throw std::runtime_error("Failed to open " + queryfile + "!");
+    }
+
+    // Open the s1o dataset and its appended deltas allowing unsorted data
+    // (this program is not performance critical) and not performing any
+    // data checks (increase memory usage), with the rtree variant it was
+    // packed with.
 
     std::cerr
         << "Opening dataset "
@@ -292,56 +557,39 @@ int main(int argc, const char* argv[])
         << "..."
         << std::endl;
 
-    dataset_5d inds(infile, 0, s1o::S1O_FLAGS_ALLOW_UNSORTED |
-        s1o::S1O_FLAGS_NO_DATA_CHECK, slots);
+    s1o_example::misc::phase_profile profile("s1o2su_q",
+        profile_file.size() != 0);
 
-    // Extract the selected slot.
+    query_runner runner(infile, slots, slot, query, !batch ? 0 :
+        queryfile == "-" ? &std::cin : &queryfilestream, prefix, options,
+        aggregator.get(), zero_copy, headers_only, format, profile);
 
-    std::cerr
-        << "Dataset open."
-        << std::endl;
+    with_dataset_variant(infile, runner);
 
-    // Copy the data from the s1o dataset to stdout.
+    if (batch)
+    {
+        profile.write_json(profile_file, 0);
 
-    typedef dataset_5d::elem_l_iterator_slot dataset_iterator;
+        std::cerr
+            << "Done."
+            << std::endl;
 
-    // Show 1% of the progress at a time
+        return runner.nfailed == 0 ? 0 : 1;
+    }
 
-    size_t ndelta = inds.get_max_elements() / 100;
-    ndelta = ndelta != 0 ? ndelta : 1;
+    size_t n = runner.n;
 
     std::cerr
-        << "Copying traces..."
         << std::endl;
 
-    size_t n;
-
-    // Select the right method from the query type (if specified).
-
-    switch(query.get_query_type())
-    {
-    case QUERY_TYPE_NONE:
-        n = copy_traces_no_query(inds, slot, ndelta);
-        break;
-    case QUERY_TYPE_RANGE:
-        n = copy_traces_range(inds, slot, ndelta, query);
-        break;
-    case QUERY_TYPE_NEAREST:
-        n = copy_traces_nearest(inds, slot, ndelta, query);
-        break;
-    case QUERY_TYPE_EXACT:
-        n = copy_traces_exact(inds, slot, ndelta, query);
-        break;
-    default:
-        throw std::runtime_error("Unknown query type!");
-    }
-
     std::cerr
+        << (aggregator ? "Aggregated " : "Copied ") << n << " traces."
         << std::endl;
 
-    std::cerr
-        << "Copied " << n << " traces."
-        << std::endl;
+    if (options.explain != 0)
+        options.explain->print(std::cerr);
+
+    profile.write_json(profile_file, n);
 
     std::cerr
         << "Done."
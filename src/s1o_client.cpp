@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/serve_protocol.hpp"
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Copy the traces left in the socket to the output, holding back the
+// last bytes received until the server closes the connection, since they
+// are the trailer. Fails unless the trailer reports the end of the
+// traces and the bytes copied match it.
+
+size_t copy_stream(int infd, int outfd)
+{
+    using namespace s1o_example::io;
+
+    std::vector<char> buffer(serve_trailer_size + (1 << 20));
+
+    size_t held = 0;
+    uint64_t total = 0;
+
+    for (;;)
+    {
+        ssize_t n = read(infd, &buffer[held], buffer.size() - held);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                throw std::runtime_error("Timed out reading the socket!");
+
+            throw std::runtime_error("Failed to read from the socket!");
+        }
+
+        if (n == 0)
+            break;
+
+        held += static_cast<size_t>(n);
+
+        if (held <= serve_trailer_size)
+            continue;
+
+        // Write everything but the possible trailer.
+
+        const char* p = &buffer[0];
+        size_t remaining = held - serve_trailer_size;
+
+        total += remaining;
+
+        while (remaining != 0)
+        {
+            ssize_t m = write(outfd, p, remaining);
+
+            if (m < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                throw std::runtime_error("Failed to write to the output!");
+            }
+
+            p += m;
+            remaining -= static_cast<size_t>(m);
+        }
+
+        std::memmove(&buffer[0], p, serve_trailer_size);
+        held = serve_trailer_size;
+    }
+
+    std::string status = held == serve_trailer_size ?
+        parse_trailer(&buffer[0]) : std::string();
+
+    if (status.empty())
+        throw std::runtime_error("The server closed the connection before "
+            "the end of the traces!");
+
+    std::vector<std::string> fields;
+    boost::algorithm::split(fields, status, boost::algorithm::is_any_of(
+        "\t"), boost::algorithm::token_compress_off);
+
+    if (fields[0] == "ERROR")
+    {
+        size_t tab = status.find('\t');
+
+        throw std::runtime_error(tab == std::string::npos ? status :
+            status.substr(tab + 1));
+    }
+
+    if (fields[0] != "END" || fields.size() != 3 ||
+        boost::lexical_cast<uint64_t>(fields[2]) != total)
+    {
+        throw std::runtime_error("Malformed end of the traces!");
+    }
+
+    return boost::lexical_cast<size_t>(fields[1]);
+}
+
+// This program sends a query to s1o_serve and writes the traces it
+// returns. After the socket, it takes the dataset, slots, slot and query
+// arguments of s1o2su_q, but none of its output options (-f, -e, -a, -H
+// and -p), only -s to keep the search order.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    // Check if the traces keep the order of the search.
+
+    bool file_order = true;
+    int argi = 1;
+
+    if (argc > 1 && std::strcmp(argv[1], "-s") == 0)
+    {
+        file_order = false;
+        argi = 2;
+    }
+
+    if (argc - argi < 4)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-s] socket s1ofile nslots slot [query] "
+            << "> sufile"
+            << std::endl;
+        return 1;
+    }
+
+    // Ensure binary data does not output to terminal.
+
+    if (isatty(fileno(stdout)))
+    {
+        std::cerr
+            << "Error: stdout must be a file or a pipe, not TTY!"
+            << std::endl;
+        return 1;
+    }
+
+    std::string socketfile(argv[argi]);
+
+    serve_request request;
+
+    request.dataset = argv[argi + 1];
+    request.slots = boost::lexical_cast<size_t>(argv[argi + 2]);
+    request.slot = boost::lexical_cast<size_t>(argv[argi + 3]);
+    request.file_order = file_order;
+
+    // Assemble the query back in case it was split by the terminal.
+
+    for (int i = argi + 4; i < argc; i++)
+        request.query += argv[i];
+
+    int fd = connect_socket(socketfile);
+
+    std::string status;
+
+    try
+    {
+        serve_send_all(fd, format_request(request));
+
+        if (!serve_recv_line(fd, status))
+            throw std::runtime_error("The server closed the connection!");
+
+        if (status != "OK")
+        {
+            size_t tab = status.find('\t');
+
+            throw std::runtime_error(tab == std::string::npos ? status :
+                status.substr(tab + 1));
+        }
+
+        copy_stream(fd, fileno(stdout));
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+
+    return 0;
+}
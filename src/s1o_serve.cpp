@@ -0,0 +1,521 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/serve_protocol.hpp"
+#include "hpg/trace_query.hpp"
+#include "hpg/query_parser.hpp"
+#include "hpg/dataset_chain.hpp"
+#include "hpg/dataset_variants.hpp"
+#include "hpg/trace_writer.hpp"
+
+#include <s1o/traits/num_spatial_dims.hpp>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+namespace {
+
+// Set by SIGINT and SIGTERM to stop accepting clients.
+
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+// A served dataset and its deltas, opened with the type of the rtree
+// variant they were packed with.
+
+struct served_chain
+{
+    virtual ~served_chain()
+    {
+    }
+
+    virtual void check_query(
+        size_t slot,
+        const s1o_example::query::query_parser& query
+    ) const = 0;
+
+    virtual size_t copy_traces(
+        size_t slot,
+        const s1o_example::query::query_parser& query,
+        const s1o_example::io::query_options& options,
+        s1o_example::io::trace_writer& writer
+    ) const = 0;
+};
+
+template <typename D>
+struct served_chain_of : served_chain
+{
+    s1o_example::io::dataset_chain<D> chain;
+
+    served_chain_of(const std::string& file, int flags, size_t slots) :
+        chain(file, flags, slots)
+    {
+    }
+
+    void check_query(
+        size_t slot,
+        const s1o_example::query::query_parser& query
+    ) const
+    {
+        s1o_example::io::check_traces_query(chain, slot, query);
+    }
+
+    size_t copy_traces(
+        size_t slot,
+        const s1o_example::query::query_parser& query,
+        const s1o_example::io::query_options& options,
+        s1o_example::io::trace_writer& writer
+    ) const
+    {
+        // The parameters of the query are not printed and the progress is
+        // not shown.
+
+        std::ostream null_log(0);
+
+        return s1o_example::io::copy_traces_query(chain, slot,
+            std::numeric_limits<size_t>::max(), query, options, writer,
+            null_log);
+    }
+};
+
+struct served_chain_opener
+{
+    const std::string& file;
+    int flags;
+    size_t slots;
+    served_chain* chain;
+
+    served_chain_opener(const std::string& file, int flags, size_t slots) :
+        file(file),
+        flags(flags),
+        slots(slots),
+        chain(0)
+    {
+    }
+
+    template <typename D>
+    void run()
+    {
+        chain = new served_chain_of<D>(file, flags, slots);
+    }
+};
+
+// The datasets served, opened once when the server starts.
+
+struct served_datasets
+{
+    std::vector<std::string> names;
+    std::vector<size_t> slots;
+    size_t prefetch;
+    boost::ptr_vector<served_chain> chains;
+
+    const served_chain& find(
+        const std::string& name,
+        size_t nslots
+    ) const
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] != name)
+                continue;
+
+            if (slots[i] != nslots)
+            {
+                throw std::runtime_error("Dataset " + name + " has " +
+                    boost::lexical_cast<std::string>(slots[i]) +
+                    " slots!");
+            }
+
+            return chains[i];
+        }
+
+        throw std::runtime_error("Dataset " + name + " is not served!");
+    }
+};
+
+// Connections accepted by the main thread and waiting for a worker.
+
+struct client_queue
+{
+    const served_datasets* datasets;
+    unsigned int timeout;
+    std::deque<int> clients;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    void push(int fd)
+    {
+        pthread_mutex_lock(&lock);
+        clients.push_back(fd);
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+
+    void close_queue()
+    {
+        pthread_mutex_lock(&lock);
+        closed = true;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+
+    bool pop(int& fd)
+    {
+        pthread_mutex_lock(&lock);
+
+        while (clients.empty() && !closed)
+            pthread_cond_wait(&cond, &lock);
+
+        bool ok = !clients.empty();
+
+        if (ok)
+        {
+            fd = clients.front();
+            clients.pop_front();
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        return ok;
+    }
+};
+
+// Answer the request of a single client. The traces are streamed through
+// a writer owned by the client, so slow clients only hold their worker.
+
+void serve_client(const served_datasets& datasets, int fd)
+{
+    using namespace s1o::traits;
+    using namespace s1o_example::io;
+    using namespace s1o_example::query;
+
+    std::string line;
+    std::ostringstream log;
+    bool accepted = false;
+
+    try
+    {
+        if (!serve_recv_line(fd, line))
+            return;
+
+        serve_request request = parse_request(line);
+
+        log << request.dataset << " " << request.slot << " "
+            << (request.query.size() != 0 ? request.query : "-");
+
+        const served_chain& chain = datasets.find(request.dataset,
+            request.slots);
+
+        if (request.slot >= request.slots)
+            throw std::runtime_error("Slot out of range!");
+
+        query_parser query(request.query,
+            num_spatial_dims<dataset_5d>::value);
+
+        // Anything that can fail before the first trace is checked now,
+        // since the status line cannot be changed once it is sent.
+
+        chain.check_query(request.slot, query);
+
+        serve_send_all(fd, "OK\n");
+
+        accepted = true;
+
+        trace_writer writer(fd);
+
+        query_options options;
+        options.file_order = request.file_order;
+        options.prefetch = datasets.prefetch;
+
+        size_t n = chain.copy_traces(request.slot, query, options, writer);
+
+        writer.flush();
+
+        serve_send_all(fd, format_trailer("END\t" +
+            boost::lexical_cast<std::string>(n) + "\t" +
+            boost::lexical_cast<std::string>(writer.get_bytes_written())));
+
+        log << ": " << n << " traces";
+    }
+    catch (const std::exception& e)
+    {
+        log << ": " << e.what();
+
+        // Errors after the traces started streaming are reported in the
+        // trailer instead of the status line. If the socket itself failed
+        // the trailer is lost and the client sees a truncated stream.
+
+        try
+        {
+            std::string message(e.what());
+
+            std::replace(message.begin(), message.end(), '\n', ' ');
+
+            if (!accepted)
+                serve_send_all(fd, "ERROR\t" + message + "\n");
+            else
+                serve_send_all(fd, format_trailer("ERROR\t" + message));
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    log << std::endl;
+
+    std::cerr << log.str();
+}
+
+void* serve_worker(void* arg)
+{
+    client_queue& queue = *static_cast<client_queue*>(arg);
+
+    int fd;
+
+    while (queue.pop(fd))
+    {
+        try
+        {
+            s1o_example::io::set_socket_timeout(fd, queue.timeout);
+            serve_client(*queue.datasets, fd);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+
+        close(fd);
+    }
+
+    return 0;
+}
+
+}
+
+// This program keeps s1o datasets open and answers queries from clients
+// connected to a Unix domain socket, streaming the selected traces back.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    // Parse the optional number of threads serving the clients, the
+    // number of traces ahead of the output that are prefetched and the
+    // seconds a client may stay idle before it is disconnected.
+
+    size_t nthreads = 4;
+    size_t prefetch = query_options().prefetch;
+    unsigned int timeout = 30;
+    int argi = 1;
+
+    while (argc - argi > 2)
+    {
+        if (std::strcmp(argv[argi], "-j") == 0)
+        {
+            nthreads = boost::lexical_cast<size_t>(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-p") == 0)
+        {
+            prefetch = boost::lexical_cast<size_t>(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-T") == 0)
+        {
+            timeout = boost::lexical_cast<unsigned int>(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+
+        break;
+    }
+
+    if (argc - argi < 3 || ((argc - argi - 1) % 2) != 0 || nthreads == 0)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-j nthreads] [-p depth] [-T seconds] "
+            << "socket s1ofile0 nslots0 [s1ofile1 nslots1] ... "
+            << "[s1ofileN nslotsN]"
+            << std::endl;
+        return 1;
+    }
+
+    std::string socketfile(argv[argi]);
+
+    // Open all datasets and their appended deltas. The queries only read
+    // from the datasets, so they are shared by all workers.
+
+    served_datasets datasets;
+    datasets.prefetch = prefetch;
+
+    for (int i = argi + 1; i < argc; i += 2)
+    {
+        std::string infile(argv[i]);
+        size_t slots = boost::lexical_cast<size_t>(argv[i + 1]);
+
+        std::cerr
+            << "Opening dataset "
+            << infile
+            << "..."
+            << std::endl;
+
+        served_chain_opener opener(infile, s1o::S1O_FLAGS_ALLOW_UNSORTED |
+            s1o::S1O_FLAGS_NO_DATA_CHECK, slots);
+
+        with_dataset_variant(infile, opener);
+
+        datasets.chains.push_back(opener.chain);
+
+        datasets.names.push_back(infile);
+        datasets.slots.push_back(slots);
+    }
+
+    // Clients closing the connection early must not kill the server, and
+    // interrupting the server stops it cleanly.
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction action;
+
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+
+    int listenfd = listen_socket(socketfile);
+
+    client_queue queue;
+    queue.datasets = &datasets;
+    queue.timeout = timeout;
+    queue.closed = false;
+    pthread_mutex_init(&queue.lock, 0);
+    pthread_cond_init(&queue.cond, 0);
+
+    // The workers inherit the signal mask, so the signals are blocked
+    // while they are created and only the main thread, blocked in
+    // accept, is interrupted by them.
+
+    sigset_t stop_signals, old_mask;
+
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+    std::vector<pthread_t> threads(nthreads);
+    size_t nstarted;
+
+    for (nstarted = 0; nstarted < nthreads; nstarted++)
+    {
+        if (pthread_create(&threads[nstarted], 0, serve_worker,
+            &queue) != 0)
+            break;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, 0);
+
+    if (nstarted == 0)
+    {
+        close(listenfd);
+        unlink(socketfile.c_str());
+
+        throw std::runtime_error("Failed to create worker threads!");
+    }
+
+    std::cerr
+        << "Serving on "
+        << socketfile
+        << " with "
+        << nstarted
+        << " threads."
+        << std::endl;
+
+    // Accept clients until interrupted. The handler is installed without
+    // SA_RESTART, so accept returns when a signal arrives.
+
+    while (!stop_requested)
+    {
+        int fd = accept(listenfd, 0, 0);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            std::cerr
+                << "Failed to accept client: "
+                << std::strerror(errno)
+                << std::endl;
+            break;
+        }
+
+        queue.push(fd);
+    }
+
+    std::cerr
+        << "Stopping..."
+        << std::endl;
+
+    close(listenfd);
+    unlink(socketfile.c_str());
+
+    // Let the workers answer the clients already accepted.
+
+    queue.close_queue();
+
+    for (size_t t = 0; t < nstarted; t++)
+        pthread_join(threads[t], 0);
+
+    pthread_cond_destroy(&queue.cond);
+    pthread_mutex_destroy(&queue.lock);
+
+    std::cerr
+        << "Done."
+        << std::endl;
+
+    return 0;
+}
@@ -18,289 +18,529 @@
  * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include "hpg/dataset_5d.hpp"
-#include "hpg/su.hpp"
-
+#include "hpg/parallel_for.hpp"
+#include "hpg/su_header_column.hpp"
+#include "hpg/dataset_chain.hpp"
+#include "hpg/dataset_variants.hpp"
+#include "hpg/slot_copy.hpp"
+#include "hpg/phase_profile.hpp"
+
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <limits>
 #include <vector>
 
 #include <stdint.h>
 
-// Ensure two trace headers are equal.
+// Functor used to copy each slot in a separate worker. Every slot is
+// stored in a different region of each part, so the workers never write
+// to the same memory.
+
+template <typename D>
+struct slot_copier
+{
+    boost::ptr_vector<D>& parts;
+    const std::vector<std::string>& infiles;
+    std::vector<size_t>& counts;
+    size_t ndelta;
+    s1o_example::io::su_endian endian;
+
+    slot_copier(
+        boost::ptr_vector<D>& parts,
+        const std::vector<std::string>& infiles,
+        std::vector<size_t>& counts,
+        size_t ndelta,
+        s1o_example::io::su_endian endian
+    ) :
+        parts(parts),
+        infiles(infiles),
+        counts(counts),
+        ndelta(ndelta),
+        endian(endian)
+    {
+    }
 
-void assert_same_header(
-    const s1o_example::io::trace_header& a,
-    const s1o_example::io::trace_header& b
-);
+    void operator()(size_t slot)
+    {
+        counts[slot] = s1o_example::io::copy_slot(parts, slot,
+            infiles[slot], ndelta, endian);
+    }
+};
 
-// This program will pack several SU files into a single s1o dataset as
-// long as they have the same headers in the same order.
+// Get the size of a dataset chain with the type of its rtree variant.
 
-int main(int argc, const char* argv[])
+struct chain_summary
+{
+    const std::string& file;
+    size_t slots;
+    size_t max_elements;
+    size_t parts;
+
+    chain_summary(const std::string& file, size_t slots) :
+        file(file),
+        slots(slots),
+        max_elements(0),
+        parts(0)
+    {
+    }
+
+    template <typename D>
+    void run()
+    {
+        s1o_example::io::dataset_chain<D> chain(file,
+            s1o::S1O_FLAGS_ALLOW_UNSORTED | s1o::S1O_FLAGS_NO_DATA_CHECK,
+            slots);
+
+        max_elements = chain.get_max_elements();
+        parts = chain.size();
+    }
+};
+
+// Read the next run of at most max_headers trace headers of the reference
+// file in batches, changing their ids to a sequential value starting in 1
+// as required by s1o. The run is empty once the file ends.
+
+template <typename R>
+void read_reference_headers(
+    R& inds,
+    std::vector<s1o_example::io::trace_header>& headers,
+    size_t max_headers
+)
 {
     using namespace s1o_example::io;
 
-    if (argc < 3)
+    const size_t batch_size = 16 * su_dataset::su_decode_block;
+
+    headers.clear();
+
+    while (headers.size() < max_headers)
+    {
+        size_t first = headers.size();
+        size_t m = std::min(batch_size, max_headers - first);
+
+        headers.resize(first + m);
+        m = inds.read_trace_headers(&headers[first], m);
+        headers.resize(first + m);
+
+        if (m == 0)
+            break;
+    }
+
+    for (size_t i = 0; i < headers.size(); i++)
+        headers[i].Id = i + 1;
+}
+
+// Pack the traces with the type of the selected rtree variant. The
+// reference headers are read in runs of at most max_headers and each run
+// becomes a part of the dataset chain with its own index: the base
+// dataset followed by deltas, or only deltas when appending. Only one
+// run is in memory at a time, so the limit bounds the headers and the
+// index being built. The data of all slots is then copied to the parts
+// in order.
+
+struct dataset_packer
+{
+    const std::string& basefile;
+    const std::vector<std::string>& infiles;
+    size_t max_headers;
+    size_t first_delta;
+    bool encode;
+    size_t nthreads;
+    s1o_example::io::su_endian endian;
+    s1o_example::misc::phase_profile& profile;
+    std::vector<std::string> deltas;
+    size_t n;
+
+    dataset_packer(
+        const std::string& basefile,
+        const std::vector<std::string>& infiles,
+        size_t max_headers,
+        size_t first_delta,
+        bool encode,
+        size_t nthreads,
+        s1o_example::io::su_endian endian,
+        s1o_example::misc::phase_profile& profile
+    ) :
+        basefile(basefile),
+        infiles(infiles),
+        max_headers(max_headers),
+        first_delta(first_delta),
+        encode(encode),
+        nthreads(nthreads),
+        endian(endian),
+        profile(profile),
+        deltas(),
+        n(0)
     {
-        std::cerr
-            << "USAGE: PROGRAM sufile0 [sufile1] ... [sufileN] s1ofile"
-            << std::endl;
-        return 1;
     }
 
-    std::vector<trace_header> headers;
-    std::vector<uint64_t> fofs;
+    template <typename D>
+    void run()
+    {
+        using namespace s1o_example::io;
 
-    // Load the headers from the first SU file and convert them to the
-    // trace_header format. These will be the reference headers.
+        if (is_segy_filename(infiles[0]))
+            pack<segy_dataset, D>();
+        else
+            pack<su_input_dataset, D>();
+    }
+
+    // Build the index of every part from the runs of reference headers.
+    // Returns the names of the parts.
 
+    template <typename R, typename D>
+    std::vector<std::string> build_parts()
     {
-        std::string infile(argv[1]);
+        using namespace s1o_example::io;
+
+        size_t slots = infiles.size();
+
+        std::vector<std::string> names;
+        std::vector<trace_header> headers;
 
         std::cerr
             << "Reading trace headers from "
-            << infile
+            << infiles[0]
             << "..."
             << std::endl;
 
-        su_dataset inds(infile);
+        R inds(infiles[0], endian);
 
-        trace_header header;
-        uint64_t id; // s1o objects must have an id sequenced from 1 to N.
-
-        for (id = 1; inds.read_trace_header(header); id++)
+        for (;;)
         {
-            // Keep the original file offset.
+            profile.begin("header_scan");
+            read_reference_headers(inds, headers, max_headers);
+            profile.end(headers.size());
 
-            fofs.push_back(header.Id);
+            if (headers.size() == 0)
+                break;
 
-            // Change the id of the trace header to be a sequential
-            // value starting in 1 and store the header.
+            // The first part is the base dataset, unless appending.
 
-            header.Id = id;
-            headers.push_back(header);
-        }
+            std::string name = basefile;
 
-        if (headers.size() == 0)
-            throw std::runtime_error("The input file has no headers!");
+            if (first_delta != 0 || names.size() != 0)
+            {
+                deltas.push_back(get_delta_name(first_delta +
+                    names.size()));
+                name = basefile + "." + deltas.back();
+            }
 
-        std::cerr
-            << "Read "
-            << headers.size()
-            << " headers."
-            << std::endl;
-    }
+            // Store the encoded SU headers, still ordered by uid, so the
+            // extractors can copy them directly. Any column left from a
+            // previous pack is removed, since it would not match the new
+            // dataset.
+
+            if (encode)
+            {
+                profile.begin("header_encode");
+                su_header_column::write(name, headers.begin(),
+                    headers.end());
+                profile.end(headers.size());
+            }
+            else
+            {
+                std::remove(su_header_column::get_filename(name).c_str());
+            }
 
-    // Create the s1o dataset from the sequence of headers. This will already
-    // set the ordering of the data inside the data file to follow the
-    // ordering of the headers in the search tree.
+            // Create the s1o dataset from the sequence of headers. This
+            // will already set the ordering of the data inside the data
+            // file to follow the ordering of the headers in the search
+            // tree.
 
-    std::string outfile = argv[argc - 1];
-    size_t slots = argc - 2;
+            std::cerr
+                << "Initializing output dataset "
+                << name
+                << " with "
+                << headers.size()
+                << " traces and "
+                << slots
+                << " slots..."
+                << std::endl;
 
-    std::cerr
-        << "Initializing output dataset "
-        << outfile
-        << " with "
-        << slots
-        << " slots..."
-        << std::endl;
+            profile.begin("index_build");
+            D outds(name, 0, slots, headers.begin(), headers.end());
+            profile.end(headers.size());
 
-    dataset_5d outds(outfile, 0, slots, headers.begin(), headers.end());
+            // Ensure everything was written to the file.
 
-    // Ensure everything was written to the file.
+            profile.begin("sync_metadata");
+            outds.sync_metadata();
+            profile.end();
 
-    outds.sync_metadata();
+            names.push_back(name);
 
-    std::cerr
-        << "Output dataset initialized."
-        << std::endl;
+            if (headers.size() < max_headers)
+                break;
+        }
 
-    // Copy the data from the SU files to the new dataset.
+        if (names.size() == 0)
+            throw std::runtime_error("The input file has no headers!");
 
-    std::vector<sample_t> insamples;
+        return names;
+    }
 
-    typedef dataset_5d::element_pair dataset_element_pair;
+    template <typename R, typename D>
+    void pack()
+    {
+        size_t slots = infiles.size();
 
-    // Show 1% of the progress at a time
+        std::vector<std::string> names = build_parts<R, D>();
 
-    size_t ndelta = headers.size() / 100;
-    ndelta = ndelta != 0 ? ndelta : 1;
+        // Open the parts again to copy the data, without their headers in
+        // memory.
 
-    std::cerr
-        << "Copying traces..."
-        << std::endl;
+        boost::ptr_vector<D> parts;
+        size_t ntraces = 0;
 
-    size_t n = 0;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            parts.push_back(new D(names[i], 0,
+                s1o::S1O_FLAGS_ALLOW_UNSORTED | s1o::S1O_FLAGS_NO_DATA_CHECK,
+                slots));
 
-    for (size_t slot = 0; slot < slots; slot++)
-    {
-        size_t arg = slot + 1;
-        std::string infile = argv[arg];
+            ntraces += parts.back().get_max_elements();
+        }
+
+        std::cerr
+            << "Output dataset initialized with "
+            << ntraces
+            << " traces in "
+            << parts.size()
+            << " part(s)."
+            << std::endl;
+
+        // Copy the data from the SU files to the new dataset.
+
+        // Show 1% of the progress at a time, only when copying
+        // sequentially.
+
+        size_t ndelta = ntraces / 100;
+        ndelta = ndelta != 0 ? ndelta : 1;
+        ndelta = nthreads == 1 ? ndelta : 0;
 
         std::cerr
-            << infile;
+            << "Copying traces using "
+            << std::min(nthreads, slots)
+            << " thread(s)..."
+            << std::endl;
+
+        std::vector<size_t> counts(slots, 0);
+        slot_copier<D> copier(parts, infiles, counts, ndelta, endian);
 
-        su_dataset inds(infile);
+        // Errors from all slots are reported together after every worker
+        // finishes.
 
-        s1o::uid_t uid;
-        trace_header inheader;
-        trace_header* p_outheader;
-        char* p_outdata;
+        profile.begin("data_copy");
 
-        for (uid = 1; inds.read_trace(inheader, insamples); uid++, n++)
+        s1o_example::misc::parallel_for(slots, nthreads, copier);
+
+        for (size_t slot = 0; slot < slots; slot++)
         {
-            if ((uid % ndelta) == 0)
+            if (nthreads != 1)
             {
                 std::cerr
-                    << ".";
+                    << infiles[slot]
+                    << ": "
+                    << counts[slot]
+                    << " traces."
+                    << std::endl;
             }
 
-            outds.get_element(uid, slot, p_outheader, p_outdata);
+            n += counts[slot];
+        }
 
-            // Headers must match.
+        profile.end(n);
 
-            assert_same_header(inheader, *p_outheader);
+        // Ensure everything was written to the file.
 
-            // Copy the samples.
+        std::cerr
+            << "Synchronizing dataset..."
+            << std::endl;
+
+        profile.begin("sync_data");
+
+        for (size_t i = 0; i < parts.size(); i++)
+            parts[i].sync_data();
+
+        profile.end();
+    }
+};
+
+// This program will pack several SU (or SEG-Y) files into a single s1o
+// dataset as long as they have the same headers in the same order.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
 
-            sample_t* outsamples = reinterpret_cast<sample_t*>(p_outdata);
+    // Parse the optional number of threads used to copy the slots, the
+    // optional limit in MiB of the trace headers of each part, whether the
+    // traces are appended to an existing dataset, whether the SU files
+    // are big-endian, whether the SU headers are stored pre-encoded, the
+    // rtree variant of the index and the file receiving the profile of
+    // the phases.
+
+    size_t nthreads = 1;
+    size_t max_header_mib = 0;
+    bool append = false;
+    bool encode = false;
+    std::string variant;
+    std::string profile_file;
+    su_endian endian = SU_ENDIAN_NATIVE;
+    int argi = 1;
+
+    while (argc - argi > 2)
+    {
+        if (std::strcmp(argv[argi], "-c") == 0)
+        {
+            encode = true;
+            argi += 1;
+            continue;
+        }
 
-            std::copy(insamples.begin(), insamples.end(), outsamples);
+        if (std::strcmp(argv[argi], "-a") == 0)
+        {
+            append = true;
+            argi += 1;
+            continue;
+        }
+
+        if (std::strcmp(argv[argi], "-b") == 0)
+        {
+            endian = SU_ENDIAN_BIG;
+            argi += 1;
+            continue;
         }
 
+        if (std::strcmp(argv[argi], "-j") == 0)
+            nthreads = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-m") == 0)
+            max_header_mib = boost::lexical_cast<size_t>(argv[argi + 1]);
+        else if (std::strcmp(argv[argi], "-r") == 0)
+            variant = argv[argi + 1];
+        else if (std::strcmp(argv[argi], "-t") == 0)
+            profile_file = argv[argi + 1];
+        else
+            break;
+
+        argi += 2;
+    }
+
+    if (argc - argi < 2 || nthreads == 0)
+    {
         std::cerr
+            << "USAGE: PROGRAM [-a] [-b] [-c] [-j nthreads] "
+            << "[-m part_header_mib] [-r variant] [-t profile.json] sufile0 "
+            << "[sufile1] ... "
+            << "[sufileN] s1ofile"
+            << std::endl
+            << "RTREE VARIANTS:"
+            << std::endl
+            << "  " << get_rtree_variant_names()
+            << " (default " << get_default_rtree_variant() << ")"
             << std::endl;
+        return 1;
+    }
+
+    if (variant.size() != 0)
+        check_rtree_variant(variant);
+
+    s1o_example::misc::phase_profile profile("su2s1o",
+        profile_file.size() != 0);
+
+    std::vector<std::string> infiles(argv + argi, argv + argc - 1);
+    std::string basefile = argv[argc - 1];
+    size_t first_delta = 0;
+
+    // When appending, the traces are packed into new delta datasets
+    // with their own index, so the cost depends only on the new traces.
+    // The base must exist and have the same number of slots, and the
+    // delta uses the same rtree variant, so the chain has a single type.
 
-        // The number of traces must match.
+    if (append)
+    {
+        std::string base_variant = get_dataset_variant(basefile);
 
-        if (uid-1 != headers.size())
+        if (variant.size() != 0 && variant != base_variant)
         {
-            throw std::runtime_error(
-                std::string("The number of traces in file ") +
-                infile + " differ from dataset: " +
-                boost::lexical_cast<std::string>(uid-1) + " vs " +
-                boost::lexical_cast<std::string>(headers.size()) + "!");
+            throw std::runtime_error("The dataset " + basefile +
+                " uses the rtree variant " + base_variant + "!");
         }
+
+        variant = base_variant;
+
+        chain_summary base(basefile, infiles.size());
+        with_rtree_variant(variant, base);
+
+        first_delta = read_delta_names(basefile).size() + 1;
+
+        std::cerr
+            << "Appending to dataset "
+            << basefile
+            << " with "
+            << base.max_elements
+            << " traces in "
+            << base.parts
+            << " part(s)..."
+            << std::endl;
     }
+    else
+    {
+        // The deltas of a previous dataset packed to the same file would
+        // not match the new one.
 
-    // Ensure everything was written to the file.
+        std::remove(get_deltas_filename(basefile).c_str());
+    }
 
-    std::cerr
-        << "Synchronizing dataset..."
-        << std::endl;
+    if (variant.size() == 0)
+        variant = get_default_rtree_variant();
 
-    outds.sync_data();
+    // Without a limit all headers are read in a single run.
 
-    std::cerr
-        << "Copied " << n << " traces."
-        << std::endl;
+    size_t max_headers = max_header_mib != 0 ?
+        std::max<size_t>(max_header_mib * 1024 * 1024 / sizeof(trace_header),
+            1) :
+        std::numeric_limits<size_t>::max();
 
     std::cerr
-        << "Done."
+        << "Packing "
+        << infiles.size()
+        << " slots with rtree "
+        << variant
+        << "..."
         << std::endl;
 
-    return 0;
-}
-
-// Ensure two trace headers are equal.
+    dataset_packer packer(basefile, infiles, max_headers, first_delta,
+        encode, nthreads, endian, profile);
 
-void assert_same_header(
-    const s1o_example::io::trace_header& a,
-    const s1o_example::io::trace_header& b
-)
-{
-    if (a.CDP != b.CDP)
-    {
-        throw std::runtime_error(
-            std::string("The field CDP of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.CDP) + " vs " +
-            boost::lexical_cast<std::string>(b.CDP) + "!");
-    }
+    with_rtree_variant(variant, packer);
 
-    if (a.Offset != b.Offset)
-    {
-        throw std::runtime_error(
-            std::string("The field Offset of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.Offset) + " vs " +
-            boost::lexical_cast<std::string>(b.Offset) + "!");
-    }
+    size_t n = packer.n;
 
-    if (a.SrcX != b.SrcX)
-    {
-        throw std::runtime_error(
-            std::string("The field SrcX of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.SrcX) + " vs " +
-            boost::lexical_cast<std::string>(b.SrcX) + "!");
-    }
+    // Only make the deltas visible after all of their data is written.
 
-    if (a.SrcY != b.SrcY)
-    {
-        throw std::runtime_error(
-            std::string("The field SrcY of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.SrcY) + " vs " +
-            boost::lexical_cast<std::string>(b.SrcY) + "!");
-    }
+    if (!append)
+        write_dataset_variant(basefile, variant);
 
-    if (a.RcvX != b.RcvX)
-    {
-        throw std::runtime_error(
-            std::string("The field RcvX of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.RcvX) + " vs " +
-            boost::lexical_cast<std::string>(b.RcvX) + "!");
-    }
+    for (size_t i = 0; i < packer.deltas.size(); i++)
+        register_delta(basefile, packer.deltas[i]);
 
-    if (a.RcvY != b.RcvY)
-    {
-        throw std::runtime_error(
-            std::string("The field RcvY of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.RcvY) + " vs " +
-            boost::lexical_cast<std::string>(b.RcvY) + "!");
-    }
+    std::cerr
+        << "Copied " << n << " traces."
+        << std::endl;
 
-    if (a.Delrt != b.Delrt)
-    {
-        throw std::runtime_error(
-            std::string("The field Delrt of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.Delrt) + " vs " +
-            boost::lexical_cast<std::string>(b.Delrt) + "!");
-    }
+    profile.write_json(profile_file, n);
 
-    if (a.Ns != b.Ns)
-    {
-        throw std::runtime_error(
-            std::string("The field Ns of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.Ns) + " vs " +
-            boost::lexical_cast<std::string>(b.Ns) + "!");
-    }
+    std::cerr
+        << "Done."
+        << std::endl;
 
-    if (a.Dt != b.Dt)
-    {
-        throw std::runtime_error(
-            std::string("The field Dt of the trace ") +
-            boost::lexical_cast<std::string>(a.Id) + " at byte " +
-            boost::lexical_cast<std::string>(b.Id) + " differ: " +
-            boost::lexical_cast<std::string>(a.Dt) + " vs " +
-            boost::lexical_cast<std::string>(b.Dt) + "!");
-    }
+    return 0;
 }
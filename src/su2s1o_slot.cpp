@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2019 Caian Benedicto <caianbene@gmail.com>
+ *
+ * This file is part of s1o_example.
+ *
+ * s1o_example is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * s1o_example is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Make; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "hpg/dataset_chain.hpp"
+#include "hpg/dataset_variants.hpp"
+#include "hpg/slot_copy.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <string>
+
+// Copy the traces of a single SU file to a slot of the base dataset and
+// then of each delta, in order. The slot is replaced in place, so all
+// headers are checked in a first pass and no sample is written unless
+// the whole file matches the dataset.
+
+template <typename R, typename D>
+size_t copy_chain_slot(
+    s1o_example::io::dataset_chain<D>& chain,
+    size_t slot,
+    const std::string& infile,
+    size_t ndelta,
+    s1o_example::io::su_endian endian
+)
+{
+    using namespace s1o_example::io;
+
+    {
+        R inds(infile, endian);
+
+        size_t n = 0;
+
+        for (size_t i = 0; i < chain.size(); i++)
+        {
+            size_t ntraces = chain[i].get_max_elements();
+            size_t nchecked = check_traces_in_slot(inds, chain[i], slot,
+                ntraces);
+
+            n += nchecked;
+
+            if (nchecked != ntraces)
+                break;
+        }
+
+        assert_no_more_traces(inds, infile, n, chain.get_max_elements());
+    }
+
+    R inds(infile, endian);
+
+    size_t n = copy_traces_to_parts(inds, chain, slot, ndelta);
+
+    assert_no_more_traces(inds, infile, n, chain.get_max_elements());
+
+    return n;
+}
+
+// Open a dataset for writing with the type of its rtree variant and
+// replace the data of the slot.
+
+struct slot_replacer
+{
+    const std::string& outfile;
+    size_t slots;
+    size_t slot;
+    const std::string& infile;
+    s1o_example::io::su_endian endian;
+    size_t n;
+
+    slot_replacer(
+        const std::string& outfile,
+        size_t slots,
+        size_t slot,
+        const std::string& infile,
+        s1o_example::io::su_endian endian
+    ) :
+        outfile(outfile),
+        slots(slots),
+        slot(slot),
+        infile(infile),
+        endian(endian),
+        n(0)
+    {
+    }
+
+    template <typename D>
+    void run()
+    {
+        using namespace s1o_example::io;
+
+        dataset_chain<D> chain(outfile, s1o::S1O_FLAGS_ALLOW_UNSORTED |
+            s1o::S1O_FLAGS_NO_DATA_CHECK, slots);
+
+        std::cerr
+            << "Dataset open."
+            << std::endl;
+
+        // Show 1% of the progress at a time
+
+        size_t ndelta = chain.get_max_elements() / 100;
+        ndelta = ndelta != 0 ? ndelta : 1;
+
+        std::cerr
+            << "Copying traces..."
+            << std::endl;
+
+        std::cerr
+            << infile;
+
+        n = is_segy_filename(infile) ?
+            copy_chain_slot<segy_dataset>(chain, slot, infile, ndelta,
+                endian) :
+            copy_chain_slot<su_input_dataset>(chain, slot, infile, ndelta,
+                endian);
+
+        std::cerr
+            << std::endl;
+
+        // Ensure everything was written to the file.
+
+        std::cerr
+            << "Synchronizing dataset..."
+            << std::endl;
+
+        for (size_t i = 0; i < chain.size(); i++)
+            chain[i].sync_data();
+    }
+};
+
+// This program will replace the data of a single slot of an existing s1o
+// dataset with the samples of an SU file, as long as the SU file has the
+// same headers in the same order as the dataset. Only the data of the
+// selected slot is written.
+
+int main(int argc, const char* argv[])
+{
+    using namespace s1o_example::io;
+
+    // Check if the SU file is big-endian.
+
+    su_endian endian = SU_ENDIAN_NATIVE;
+    int argi = 1;
+
+    if (argc > 1 && std::strcmp(argv[1], "-b") == 0)
+    {
+        endian = SU_ENDIAN_BIG;
+        argi = 2;
+    }
+
+    if (argc - argi != 4)
+    {
+        std::cerr
+            << "USAGE: PROGRAM [-b] s1ofile nslots slot sufile"
+            << std::endl;
+        return 1;
+    }
+
+    std::string outfile(argv[argi]);
+    size_t slots = boost::lexical_cast<size_t>(argv[argi + 1]);
+    size_t slot = boost::lexical_cast<size_t>(argv[argi + 2]);
+    std::string infile(argv[argi + 3]);
+
+    // The number of slots is fixed in the layout of the data file, so
+    // new slots can only be added by repacking the dataset.
+
+    if (slot >= slots)
+    {
+        std::cerr
+            << "Error: slot "
+            << slot
+            << " does not exist, adding slots requires repacking with "
+            << "su2s1o!"
+            << std::endl;
+        return 1;
+    }
+
+    // Open the s1o dataset and its appended deltas for writing. The SU
+    // file must contain the traces of the base dataset followed by the
+    // traces of each delta, in the order they were appended.
+
+    std::cerr
+        << "Opening dataset "
+        << outfile
+        << "..."
+        << std::endl;
+
+    slot_replacer replacer(outfile, slots, slot, infile, endian);
+
+    with_dataset_variant(outfile, replacer);
+
+    size_t n = replacer.n;
+
+    std::cerr
+        << "Copied " << n << " traces."
+        << std::endl;
+
+    std::cerr
+        << "Done."
+        << std::endl;
+
+    return 0;
+}